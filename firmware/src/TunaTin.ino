@@ -91,9 +91,20 @@
 #include "ee.h"
 #include "oled.h"
 #include "si5351.h"
+#include "pins.h"
 #include "lookup.h"
 #include "font.h"
 
+// pins used by the interrupt handlers and the keyer
+typedef PIN(ROTA)    PinRotA;
+typedef PIN(ROTB)    PinRotB;
+typedef PIN(SW1)     PinSw1;
+typedef PIN(SW2)     PinSw2;
+typedef PIN(DIT)     PinDit;
+typedef PIN(DAH)     PinDah;
+typedef PIN(KEYOUT)  PinKeyOut;
+typedef PIN(TXLED)   PinTxLed;
+
 // generic
 #define OFF      0
 #define ON       1
@@ -129,17 +140,27 @@ void show_help();
 void show_cal();
 void show_info();
 void show_debug();
+void set_tunemode();
+void show_i2c();
+void show_regs(uint8_t addr, uint8_t *buf, uint8_t n);
+void show_vfo();
+void bench_tune();
 void wait_ms(uint16_t dly);
 void wait_us(uint16_t dly);
+uint32_t t0_time();
+uint32_t us_time();
 void blinkLED();
 void error_blink();
 void stepsize_cursor();
-inline void CAT_VFO();
+inline void CAT_VFO(uint32_t freq);
+void CAT_OFS(int32_t ofs);
 void check_CAT();
 inline void CAT_cmd();
 void save_eeprom();
 void init_VFO();
 void init_wpm();
+uint32_t wpm_time(uint8_t n);
+void init_keyer();
 void init_freq();
 void init_timer0();
 void init_timer1();
@@ -159,8 +180,17 @@ void minsky();
 void read_adc();
 void set_oled_timeout();
 void set_tx_status(uint8_t tx);
+void key_clk();
 void freq2band(uint32_t freq);
+void set_vfo(uint32_t freq, uint8_t clk);
+void set_plan();
+void park_ritxit();
+void set_ritxit(uint8_t mode);
+void set_ritofs(int32_t ofs);
+void set_txoffset(int32_t ofs);
+void CAT_RIT(char *cmd);
 void update_display();
+void draw_vfo();
 void check_timeout();
 void check_UI();
 void check_menu();
@@ -173,17 +203,37 @@ void update_vfo();
 void reset_xtimer();
 void do_reset(uint8_t soft);
 void run_calibrate();
+void show_plan();
+void show_alloc(const char *label, uint64_t freq, uint8_t clk);
 
 char lookup_cw(uint8_t addr);
-void print_cw();
+void print_cw(uint8_t addr);
+void show_cw();
+void post_cw(uint8_t addr);
 void maddr_cmd(uint8_t cmd);
 void read_paddles();
+void pad_debounce();
+void key_time(uint32_t t);
+void key_next(uint32_t t);
+uint8_t key_due();
+uint8_t key_sched();
+void key_jitter();
+void ky_put(char ch);
+uint8_t ky_room();
+uint8_t ky_next();
+uint8_t ky_char();
+void ky_elem();
+uint8_t ky_stop();
 void iambic_keyer();
+void key_tick();
 void straight_key();
+uint8_t key_gap();
+void run_display();
 
 // eeprom addresses
 #define DATA_ADDR    10      // calibration data
 #define FREQ_ADDR    20      // frequency
+#define TXOFS_ADDR   30      // Tx offset
 
 // Si5351 xtal frequency (25 MHz)
 #define SI5351_REF  25000000UL
@@ -223,13 +273,17 @@ OLED    oled;
 #define XLPRESS     1200
 #define LONGPRESS   500
 
-#define SW1_PRESSED  !digitalRead(SW1)
-#define SW2_PRESSED  !digitalRead(SW2)
+#define SW1_PRESSED  !PinSw1::read()
+#define SW2_PRESSED  !PinSw2::read()
 #define ANY_PRESSED  SW1_PRESSED | SW2_PRESSED
 
 #define INITWPM   25         // initial keyer speed
+#define MINWPM    10         // keyer speed range
+#define MAXWPM    60
 #define INITVOL    4         // initial volume
 #define INITVFO 14074000ULL  // initial vfo frequency
+#define TXOFFSET         0   // Tx offset from the Rx frequency (Hz)
+#define TXOFS_MAX    99999   // largest Tx offset (Hz)
 
 // keyer mode definitions
 #define STRAIGHT   0         // straight key
@@ -263,7 +317,9 @@ uint32_t stepsizes[] = { 0, 1, 10, 100, 1000, 10000, 100000, 1000000 };
 #define SAVE2EE     6
 #define KEYERMODE   7
 #define KEYSWAP     8
-#define SWVER       9
+#define RITXIT      9
+#define RITOFS     10
+#define SWVER      11
 
 char menulabel[][16] = {
   "Volume",
@@ -275,6 +331,8 @@ char menulabel[][16] = {
   "EEPROM Save",
   "Keyer Mode",
   "Key Swap",
+  "RIT/XIT",
+  "RIT/XIT Offset",
   "Version",
 };
 
@@ -326,13 +384,13 @@ uint8_t calibrate  = OFF;        // calibrate mode
 uint8_t save2ee    = OFF;        // save to eeprom
 int8_t  stepsize   = STEP_1K;    // freq tuning step size
 
-// keyer globals
-uint16_t dittime;        // dit time
-uint16_t dahtime;        // dah time
-uint16_t lettergap1;     // letter space for decode
-uint16_t lettergap2;     // letter space for send
-uint16_t wordgap1;       // word space for decode
-uint16_t wordgap2;       // word space for send
+// keyer globals, in 4 us timer 0 counts
+uint32_t dittime;        // dit time
+uint32_t dahtime;        // dah time
+uint32_t lettergap1;     // letter space for decode
+uint32_t lettergap2;     // letter space for send
+uint32_t wordgap1;       // word space for decode
+uint32_t wordgap2;       // word space for send
 
 // other globals
 uint8_t menumode   = NOT_IN_MENU;
@@ -342,12 +400,15 @@ int8_t  menu       = VOLUME;
 uint8_t maddr      = 1;
 uint8_t recordMsg  = OFF;
 uint8_t DEBUG      = FALSE;
-uint8_t tx_status  = OFF;
+volatile uint8_t tx_status = OFF;
+uint8_t txclk      = OFF;        // Tx clock state last posted
+uint8_t plltune    = OFF;        // tune the PLL, not the multisynth
 
 const char* cwtone_label[] = { "600", "700" };
 const char* dxbk_label[]   = { "OFF", "5 Minutes", "30 Minutes"};
 const char* keyer_label[]  = { "OFF", "Iambic A", "Iambic B", "Ultimatic"};
 const char* onoff_label[]  = { "OFF", "ON" };
+const char* ritxit_label[] = { "OFF", "RIT", "XIT", "RIT+XIT" };
 
 // for CW messages
 #define MAXLEN  50
@@ -359,7 +420,21 @@ uint32_t xtimer;
 
 // vfo frequency
 uint32_t vfofreq;
+uint32_t vfobfreq;           // VFO B, the Tx frequency in split
 uint32_t catfreq;
+uint8_t  split    = OFF;     // transmit on VFO B
+int32_t  txoffset = TXOFFSET;
+
+// RIT/XIT, one offset shared by both as on the TS-2000
+#define RIT_ON     0x01      // Rx at vfo + offset
+#define XIT_ON     0x02      // Tx at vfo + offset
+#define RIT_MAX    99999     // largest offset (Hz), as on the TS-2000
+#define RIT_MENU   100       // menu steps of 10 Hz either side
+#define PARK_RX    0         // CLK1 set for the other RIT state
+#define PARK_TX    1         // CLK0 set for the other XIT state
+uint8_t  ritxit   = OFF;     // RIT_ON | XIT_ON
+int32_t  ritofs   = 0;       // offset (Hz)
+uint8_t  ritstep;            // menu copy of the offset
 
 // per-band stored frequencies
 int32_t bandfreq[] = {
@@ -368,11 +443,67 @@ int32_t bandfreq[] = {
 };
 
 // millisecond time
+#define T0COUNTS  250        // timer 0 counts per ms (4 us each)
 volatile uint32_t msTimer = 0;
+uint8_t t0_tc;               // count part of the last t0_time()
+
+// worst-case display update stall (us)
+uint32_t stall_max = 0;
+
+// Si5351 cold-start time (us)
+uint32_t init_us = 0;
+
+// VFO retunes on Si5351 cache hits and misses
+uint16_t hit_n   = 0;
+uint16_t miss_n  = 0;
+uint32_t hit_us  = 0;        // total set_freq() time (us)
+uint32_t miss_us = 0;
+
+// display render jobs, drained by run_display()
+#define JOB_VFO     0x01     // band, keyer and frequency lines
+#define JOB_CW      0x02     // decoded text from the history
+#define DISP_MAXWAIT 250     // ms a job may wait for a key-up gap
+uint8_t  dispjobs  = 0;
+uint32_t dispstamp = 0;      // when the job queue last moved
+
+// decoded morse from the keyer tick waiting to be printed
+#define CWQLEN   16          // queue depth (power of 2)
+#define CWQMASK  (CWQLEN-1)
+uint8_t cwq[CWQLEN];
+volatile uint8_t cwqhead = 0;
+volatile uint8_t cwqtail = 0;
+
+// text from the KY command waiting to be sent
+#define KYLEN    64          // buffer size (power of 2)
+#define KYMASK   (KYLEN-1)
+#define A2M_NONE 0x4c        // a2m[] placeholder, the code for '?'
+#define KYMSG    24          // longest KY message
+char    kybuf[KYLEN];
+volatile uint8_t kyhead = 0;
+volatile uint8_t kytail = 0;
+uint8_t kysym;               // elements left in the character, MSB first
+uint8_t kyn;                 // number of elements left
+
+// keyer element timing
+#define KEY_SOON   3         // counts too close to schedule a tick
+uint32_t kdue;               // when the element or gap ends (t0_time)
+int32_t  jit_min = 0x7FFFFFFF;
+int32_t  jit_max = -0x7FFFFFFF;
+
+// paddle input seen by the keyer tick, the main
+// loop turns it into a display wake-up
+volatile uint8_t keywake = NO;
 
 // timer 0 interrupt service routine
 ISR(TIMER0_COMPA_vect) {
   msTimer++;
+  pad_debounce();
+}
+
+// timer 0 compare B, the keyer tick, the keyer runs here
+// so element timing does not depend on the main loop
+ISR(TIMER0_COMPB_vect) {
+  key_tick();
 }
 
 #define COSINIT   250
@@ -397,10 +528,50 @@ volatile uint8_t enc_state;
 volatile uint8_t enc_a;
 volatile uint8_t enc_b;
 
-// rotary encoder interrupt handler
+// paddle variables, PIND bits
+#define ENC_PINS  (PinRotA::mask | PinRotB::mask)
+#define DIT_PIN   PinDit::mask
+#define DAH_PIN   PinDah::mask
+static_assert((PinDit::port == PIND_ADDR) && (PinDah::port == PIND_ADDR) &&
+              (PinRotA::port == PIND_ADDR) && (PinRotB::port == PIND_ADDR),
+              "the paddle and encoder masks are bits of PIND");
+#define PAD_INT   3          // hold-off ms after the last contact
+#define PAD_CONF  2          // contact samples in a row for a press
+volatile uint8_t pcpins;     // PIND at the last pin change
+volatile uint8_t padlatch;   // presses not yet seen by the keyer
+volatile uint8_t ditcnt = 0; // dit contact samples in a row
+volatile uint8_t dahcnt = 0; // dah contact samples in a row
+volatile uint8_t ditint = 0; // dit integrator (ms)
+volatile uint8_t dahint = 0; // dah integrator (ms)
+
+// one paddle contact sample, from a pin change or the ms
+// tick, a press is accepted after PAD_CONF samples in a
+// row with contact and latched so the keyer sees it
+// however late it looks, presses while the integrator is
+// still charged are contact bounce
+void pad_sample(uint8_t pin, uint8_t closed,
+                volatile uint8_t *cnt, volatile uint8_t *integ) {
+  if (!closed) {
+    *cnt = 0;
+    return;
+  }
+  if (*cnt < PAD_CONF) (*cnt)++;
+  if (*cnt < PAD_CONF) return;
+  if (!*integ) padlatch |= pin;
+  *integ = PAD_INT;
+}
+
+// rotary encoder and paddle interrupt handler, a paddle
+// edge counts as one contact sample
 ISR(PCINT2_vect) {
-  enc_a = digitalRead(ROTA);
-  enc_b = digitalRead(ROTB);
+  uint8_t pins = PIND;
+  uint8_t diff = pcpins ^ pins;
+  pcpins = pins;
+  if (diff & DIT_PIN) pad_sample(DIT_PIN, !(pins & DIT_PIN), &ditcnt, &ditint);
+  if (diff & DAH_PIN) pad_sample(DAH_PIN, !(pins & DAH_PIN), &dahcnt, &dahint);
+  if (!(diff & ENC_PINS)) return;
+  enc_a = PinRotA::read();
+  enc_b = PinRotB::read();
   enc_state = (enc_state << 4) | (enc_b << 1) | enc_a;
   switch (enc_state) {
     case 0x23:  enc_val++; break;
@@ -559,15 +730,29 @@ void show_version(uint8_t x) {
   IF  G -  radio status\r\n\
   ID  G -  radio ID\r\n\
   FA  G S  frequency\r\n\
+  FB  G S  VFO B frequency\r\n\
+  FT  G S  Tx VFO (split)\r\n\
   AI  G S  auto-information\r\n\
   MD  G S  radio mode\r\n\
   PS  G S  power-on status\r\n\
+  RT  G S  RIT status\r\n\
   XT  G S  XIT status\r\n\
+  RU  - S  RIT/XIT up\r\n\
+  RD  - S  RIT/XIT down\r\n\
+  RC  - S  RIT/XIT clear\r\n\
+  KY  G S  send CW text\r\n\
+  KS  G S  keyer speed\r\n\
   TX  - S  transmit\r\n\
   RX  - S  receive\r\n\n\
   HE => print help\r\n\
   HH => print help\r\n\
   DD => debug on/off\r\n\
+  BB => I2C bus stats\r\n\
+  VV => Si5351 registers\r\n\
+  SW => tuning benchmark\r\n\
+  PT => PLL tuning on/off\r\n\
+  PA => PLL allocation\r\n\
+  TO => Tx offset\r\n\
   II => print info\r\n\
   FR => factory reset\r\n\
   SR => soft reset\r\n\
@@ -595,17 +780,146 @@ void show_info() {
   Serial.print("  freq = ");
   Serial.print(vfofreq);
   Serial.print("\r\n");
+  // print worst-case display stall
+  Serial.print("  stall = ");
+  Serial.print(stall_max);
+  Serial.print(" us\r\n");
+  // print Si5351 cold-start time
+  Serial.print("  vfo init = ");
+  Serial.print(init_us);
+  Serial.print(" us\r\n");
+  // print keyer element timing spread
+  uint8_t sreg = SREG;
+  cli();
+  int32_t jit = (jit_max > jit_min) ? (jit_max - jit_min) : 0;
+  SREG = sreg;
+  Serial.print("  jitter = ");
+  Serial.print(jit);
+  Serial.print(" us\r\n");
   show_cal();
 }
 
 // show debug status
 void show_debug() {
   DEBUG = ! DEBUG;
+  si5351.verify = DEBUG;   // read back Si5351 writes
   Serial.print("DEBUG=");
   Serial.print(DEBUG);
   Serial.println("");
 }
 
+// toggle PLL tuning, leaving it puts PLLA
+// back on the fixed 800 MHz
+void set_tunemode() {
+  plltune = ! plltune;
+  if (!plltune) {
+    si5351.set_pll(SI5351_PLL_FIXED, SI5351_PLLA);
+    si5351.pll_reset(SI5351_PLLA);
+  }
+  Serial.print("PLLTUNE=");
+  Serial.print(plltune);
+  Serial.println("");
+  update_display();
+}
+
+// print I2C bus statistics
+void show_i2c() {
+  for (uint8_t i=0; i<I2C_NDEV; i++) {
+    I2CStats *st = &i2c.stats[i];
+    if (!st->addr) continue;
+    Serial.print("  0x");
+    Serial.print(st->addr, HEX);
+    Serial.print("  nack = ");
+    Serial.print(st->nack);
+    Serial.print("  timeout = ");
+    Serial.print(st->timeout);
+    Serial.print("  buserr = ");
+    Serial.print(st->buserr);
+    Serial.print("  recover = ");
+    Serial.print(st->recover);
+    Serial.print("\r\n");
+  }
+  // print worst-case key-down to bus latency
+  Serial.print("  keywait = ");
+  Serial.print(i2c.hi_wait);
+  Serial.print(" bytes\r\n\n");
+}
+
+// print a block of Si5351 registers
+void show_regs(uint8_t addr, uint8_t *buf, uint8_t n) {
+  for (uint8_t i=0; i<n; i++) {
+    if ((i & 7) == 0) {
+      Serial.print("\r\n  ");
+      Serial.print(addr + i);
+      Serial.print(":");
+    }
+    Serial.print(" ");
+    if (buf[i] < 16) Serial.print("0");
+    Serial.print(buf[i], HEX);
+  }
+}
+
+// dump the Si5351 status, control, PLL and
+// multisynth registers with one burst read each
+void show_vfo() {
+  uint8_t buf[40];
+  si5351.read_bulk(SI5351_DEVICE_STATUS, 4, buf);
+  show_regs(SI5351_DEVICE_STATUS, buf, 4);
+  si5351.read_bulk(SI5351_CLK0_CTRL, 3, buf);
+  show_regs(SI5351_CLK0_CTRL, buf, 3);
+  si5351.read_bulk(SI5351_PLLA_PARAMETERS, 40, buf);
+  show_regs(SI5351_PLLA_PARAMETERS, buf, 40);
+  // compare the chip with the driver's shadow
+  uint8_t diffs = 0;
+  for (uint8_t i=0; i<40; i++) {
+    if (buf[i] != si5351.get_reg(SI5351_PLLA_PARAMETERS + i)) diffs++;
+  }
+  Serial.print("\r\n  shadow diffs = ");
+  Serial.print(diffs);
+  Serial.print("\r\n  verify errors = ");
+  Serial.print(si5351.verify_err);
+  // average VFO retune time with and without the math
+  Serial.print("\r\n  cache hits = ");
+  Serial.print(si5351.cache_hits);
+  Serial.print(" (");
+  Serial.print(hit_n ? hit_us / hit_n : 0);
+  Serial.print(" us)  misses = ");
+  Serial.print(si5351.cache_misses);
+  Serial.print(" (");
+  Serial.print(miss_n ? miss_us / miss_n : 0);
+  Serial.print(" us)\r\n\n");
+}
+
+// sweep the 20m band in each step size and report the
+// average Si5351 bus bytes per retune
+#define BENCH_MAX  500       // retunes per step size
+void bench_tune() {
+  i2c.flush();
+  for (uint8_t s=STEP_1; s<STEP_1M; s++) {
+    uint32_t total = 0;
+    uint16_t n = 0;
+    for (uint32_t f=14000000; (f<14350000) && (n<BENCH_MAX); f+=stepsizes[s]) {
+      uint16_t c = i2c.count();
+      set_vfo(f, SI5351_CLK1);
+      total += (uint16_t)(i2c.count() - c);
+      n++;
+    }
+    total = (total * 10) / n;
+    Serial.print("  step ");
+    Serial.print(stepsizes[s]);
+    Serial.print(": ");
+    Serial.print(n);
+    Serial.print(" retunes, ");
+    Serial.print(total / 10);
+    Serial.print(".");
+    Serial.print(total % 10);
+    Serial.print(" bytes\r\n");
+  }
+  Serial.print("\r\n");
+  // back to the vfo frequency
+  update_display();
+}
+
 // millisecond delay
 void wait_ms(uint16_t dly) {
   uint32_t startTime = msTimer;
@@ -622,6 +936,24 @@ void wait_us(uint16_t x) {
   }
 }
 
+// timer 0 time in 4 us counts
+uint32_t t0_time() {
+  uint8_t sreg = SREG;
+  cli();
+  uint32_t ms = msTimer;
+  uint8_t  tc = TCNT0;
+  // account for a pending timer 0 tick
+  if ((TIFR0 & _BV(OCF0A)) && (tc < 249)) ms++;
+  t0_tc = tc;
+  SREG = sreg;
+  return (ms * T0COUNTS) + tc;
+}
+
+// microsecond time (4 us resolution)
+uint32_t us_time() {
+  return(t0_time() << 2);
+}
+
 // blink the LED
 void blinkLED() {
   digitalWrite(TXLED,ON);
@@ -655,11 +987,51 @@ void stepsize_cursor() {
 }
 
 // print (11-bit) VFO frequency
-inline void CAT_VFO() {
-  if      (vfofreq >= 10000000) Serial.print("000");
-  else if (vfofreq >=  1000000) Serial.print("0000");
-  else                          Serial.print("00000");
-  Serial.print(vfofreq);
+inline void CAT_VFO(uint32_t freq) {
+  if      (freq >= 10000000) Serial.print("000");
+  else if (freq >=  1000000) Serial.print("0000");
+  else                       Serial.print("00000");
+  Serial.print(freq);
+}
+
+// print an offset as sign and 5 digits
+void CAT_OFS(int32_t ofs) {
+  Serial.print((ofs < 0) ? '-' : '+');
+  if (ofs < 0) ofs = -ofs;
+  for (int32_t d = 10000; d > 1; d /= 10) {
+    if (ofs < d) Serial.print('0');
+  }
+  Serial.print(ofs);
+}
+
+// RIT/XIT commands, RT and XT get or set the on/off
+// status, RU and RD move the offset by P1 Hz (10 Hz
+// without P1) and RC clears it
+void CAT_RIT(char *cmd) {
+  uint8_t bit = (cmd[0] == 'X') ? XIT_ON : RIT_ON;
+  char ch = getc();
+  if ((cmd[1] == 'T') && numeric(ch)) {
+    // set RIT or XIT status
+    getsemi();
+    if (ch == '1') set_ritxit(ritxit | bit);
+    else set_ritxit(ritxit & ~bit);
+  } else if (cmd[1] == 'T') {
+    // get RIT or XIT status, the semicolon
+    // has already been read
+    Serial.print(cmd);
+    Serial.print((ritxit & bit) ? "1;" : "0;");
+  } else if (cmd[1] == 'C') {
+    set_ritofs(0);
+  } else {
+    int32_t step = 10;
+    if (numeric(ch)) {
+      step = ch - '0';
+      for (uint8_t i=0; i<4; i++) step = (step * 10) + (getc() - '0');
+      getsemi();
+    }
+    if (cmd[1] == 'D') step = -step;
+    set_ritofs(ritofs + step);
+  }
 }
 
 // ==============================================================
@@ -670,10 +1042,18 @@ inline void CAT_VFO() {
 // IF        G -    radio status      returns frequency and other status
 // ID        G -    radio ID          returns 019 = Kenwood TS-2000
 // FA        G S    frequency         gets or sets the ADX frequency
+// FB        G S    VFO B frequency   gets or sets the split Tx frequency
+// FT        G S    Tx VFO            0 = VFO A, 1 = VFO B (split)
 // AI        G S    auto-information  returns 0   = OFF
 // MD        G S    radio mode        returns 3   = CW
 // PS        G S    power-on status   returns 1   = ON
-// XT        G S    XIT status        returns 0   = OFF
+// RT        G S    RIT status        0 = OFF, 1 = ON
+// XT        G S    XIT status        0 = OFF, 1 = ON
+// RU        - S    RIT/XIT up        offset up by P1 Hz (10 Hz)
+// RD        - S    RIT/XIT down      offset down by P1 Hz (10 Hz)
+// RC        - S    RIT/XIT clear     offset to 0 Hz
+// KY        G S    CW text           queues P2 to send, returns 0 = room, 1 = full
+// KS        G S    keyer speed       010 to 060 WPM
 // TX        - S    transmit          returns 0 and set TX LED
 // RX        - S    receive           returns 0 and clears TX LED
 //
@@ -683,6 +1063,12 @@ inline void CAT_VFO() {
 //  HH => print help
 //  II => print info
 //  DD => turn on/off debug
+//  BB => I2C bus statistics
+//  VV => Si5351 register dump
+//  SW => tuning benchmark
+//  PT => turn on/off PLL tuning
+//  PA => PLL allocation per band
+//  TO => get/set Tx offset (sign and 5 digits)
 //  FR => factory reset
 //  SR => soft reset
 //  CM => calibration mode
@@ -692,6 +1078,7 @@ inline void CAT_VFO() {
 void check_CAT() {
   if (Serial.available()) CAT_cmd();
   if (vfofreq != catfreq) {
+    vfofreq = catfreq;
     update_display();
   }
 }
@@ -727,8 +1114,12 @@ void CAT_cmd() {
   // get frequency and other status
   if (cmpstr(cmd, "IF")) {
     send("IF");
-    CAT_VFO();
-    Serial.print("00000+000000000");
+    CAT_VFO(vfofreq);
+    Serial.print("00000");
+    CAT_OFS(ritofs);
+    Serial.print((ritxit & RIT_ON) ? '1' : '0');
+    Serial.print((ritxit & XIT_ON) ? '1' : '0');
+    Serial.print("00");
     if (tx_status) Serial.print('1');
     else Serial.print('0');
     Serial.print("20000000;");
@@ -751,11 +1142,45 @@ void CAT_cmd() {
     } else {
       // get frequency
       Serial.print("FA");
-      CAT_VFO();
+      CAT_VFO(vfofreq);
       Serial.print(";");
     }
   }
 
+  // get or set the VFO B frequency
+  else if (cmpstr(cmd, "FB")) {
+    ch = getc();
+    if (numeric(ch)) {
+      // set VFO B frequency
+      catc(param, ch);
+      for (uint8_t i=0; i<10; i++) {
+        catc(param, getc());
+      }
+      vfobfreq = fs2int(param);
+      getsemi(); // get semicolon
+      set_plan();
+    } else {
+      // get VFO B frequency
+      Serial.print("FB");
+      CAT_VFO(vfobfreq);
+      Serial.print(";");
+    }
+  }
+
+  // get or set the transmit VFO (split)
+  else if (cmpstr(cmd, "FT")) {
+    ch = getc();
+    if (numeric(ch)) {
+      // set transmit VFO, 0 = A, 1 = B
+      split = (ch == '1') ? ON : OFF;
+      getsemi();
+      set_plan();
+    } else {
+      // get transmit VFO
+      Serial.print(split ? "FT1;" : "FT0;");
+    }
+  }
+
   // get or set the radio mode
   else if (cmpstr(cmd, "MD")) {
     ch = getc();
@@ -795,16 +1220,47 @@ void CAT_cmd() {
     }
   }
 
-  // get or set the XIT (ON/OFF) status
-  else if (cmpstr(cmd, "XT")) {
+  // get or set the RIT and XIT (ON/OFF) status,
+  // move or clear the shared offset
+  else if (cmpstr(cmd, "RT") || cmpstr(cmd, "XT") ||
+           cmpstr(cmd, "RU") || cmpstr(cmd, "RD") || cmpstr(cmd, "RC")) {
+    CAT_RIT(cmd);
+  }
+
+  // queue text to send as CW, or get the buffer status
+  else if (cmpstr(cmd, "KY")) {
+    ch = getc();
+    if (ch == ';') {
+      // 1 when another message would not fit
+      Serial.print((ky_room() < KYMSG) ? "KY1;" : "KY0;");
+    } else {
+      // P1 is a space, P2 the text
+      if (ch != ' ') ky_put(ch);
+      while ((ch = getc()) != ';') ky_put(ch);
+    }
+  }
+
+  // get or set the keyer speed
+  else if (cmpstr(cmd, "KS")) {
     ch = getc();
     if (numeric(ch)) {
-      // set XIT (ON/OFF) status
-      // does nothing .. always OFF
-      getsemi();
+      // set keyer speed
+      uint16_t wpm = ch - '0';
+      for (uint8_t i=0; i<2; i++) {
+        wpm = (wpm * 10) + (getc() - '0');
+      }
+      getsemi(); // get semicolon
+      if (wpm < MINWPM) wpm = MINWPM;
+      if (wpm > MAXWPM) wpm = MAXWPM;
+      keyerwpm = wpm;
+      init_wpm();
+      dispjobs |= JOB_VFO;
     } else {
-      // get XIT (ON/OFF) status
-      Serial.print("XT0;");
+      // get keyer speed
+      Serial.print("KS0");
+      Serial.print((char)('0' + (keyerwpm / 10)));
+      Serial.print((char)('0' + (keyerwpm % 10)));
+      Serial.print(";");
     }
   }
 
@@ -844,6 +1300,51 @@ void CAT_cmd() {
     show_info();
   }
 
+  // print I2C bus statistics
+  else if (cmpstr(cmd, "BB")) {
+    show_i2c();
+  }
+
+  // print Si5351 registers
+  else if (cmpstr(cmd, "VV")) {
+    show_vfo();
+  }
+
+  // tuning benchmark
+  else if (cmpstr(cmd, "SW")) {
+    bench_tune();
+  }
+
+  // toggle PLL tuning on/off
+  else if (cmpstr(cmd, "PT")) {
+    set_tunemode();
+  }
+
+  // print PLL allocation per band
+  else if (cmpstr(cmd, "PA")) {
+    show_plan();
+  }
+
+  // get or set the Tx offset
+  else if (cmpstr(cmd, "TO")) {
+    ch = getc();
+    if ((ch == '+') || (ch == '-')) {
+      // set the offset, sign and 5 digits
+      int32_t ofs = 0;
+      for (uint8_t i=0; i<5; i++) {
+        ofs = (ofs * 10) + (getc() - '0');
+      }
+      getsemi(); // get semicolon
+      set_txoffset((ch == '-') ? -ofs : ofs);
+    } else {
+      // get the offset, the semicolon
+      // has already been read
+      Serial.print("TO");
+      CAT_OFS(txoffset);
+      Serial.print(";");
+    }
+  }
+
   // factory reset
   else if (cmpstr(cmd, "FR")) {
     do_reset(FACTORY);
@@ -868,42 +1369,58 @@ void save_eeprom() {
   Serial.print("  Saving to EEPROM\r\n");
   eeprom.put32(DATA_ADDR, cal_data);
   eeprom.put32(FREQ_ADDR, vfofreq);
+  eeprom.put32(TXOFS_ADDR, txoffset);
 }
 
-// initialize the Si5351 VFO clocks
+// initialize the Si5351 VFO clocks, the power-on image
+// has the PLLs at 800 MHz, the Tx, Rx and Cal outputs
+// off and their drive strengths set (SI5351_CLKn_INIT)
 void init_VFO() {
+  uint32_t t0 = us_time();
   si5351.init();
-  si5351.set_pll(SI5351_PLL_FIXED, SI5351_PLLA);
-  si5351.output_enable(SI5351_CLK0, OFF);   // Tx off
-  si5351.output_enable(SI5351_CLK1, OFF);   // Rx off
-  si5351.output_enable(SI5351_CLK2, OFF);   // Cal off
-  // clock drive strength
-  si5351.drive_strength(SI5351_CLK0, SI5351_DRIVE_8MA);
-  si5351.drive_strength(SI5351_CLK1, SI5351_DRIVE_2MA);
-  si5351.drive_strength(SI5351_CLK2, SI5351_DRIVE_2MA);
+  init_us = us_time() - t0;
 }
 
-#define DITCONST  1200   // dit time constant
+#define HALFDIT   150000UL  // half a dit at 1 WPM (4 us counts)
 
-// initialize the keyer speed
+// initialize the keyer speed, the keyer
+// tick must not see a half-written time
 void init_wpm() {
-  dittime    = DITCONST/keyerwpm;
-  dahtime    = (DITCONST * 3)/keyerwpm;
-  lettergap1 = (DITCONST * 2.5)/keyerwpm;
-  lettergap2 = (DITCONST * 3)/keyerwpm;
-  wordgap1   = (DITCONST * 3)/keyerwpm;
-  wordgap2   = (DITCONST * 7)/keyerwpm;
+  uint32_t t[6];
+  t[0] = wpm_time(2);
+  t[1] = wpm_time(6);
+  t[2] = wpm_time(5);
+  t[3] = wpm_time(6);
+  t[4] = wpm_time(6);
+  t[5] = wpm_time(14);
+  uint8_t sreg = SREG;
+  cli();
+  dittime    = t[0];
+  dahtime    = t[1];
+  lettergap1 = t[2];
+  lettergap2 = t[3];
+  wordgap1   = t[4];
+  wordgap2   = t[5];
+  SREG = sreg;
+}
+
+// n half dits at the keyer speed in
+// timer 0 counts, rounded to nearest
+uint32_t wpm_time(uint8_t n) {
+  return(((HALFDIT * n) + (keyerwpm >> 1)) / keyerwpm);
 }
 
 // initialize the Si5351 frequency
 void init_freq() {
   si5351.set_correction(cal_data, SI5351_PLL_INPUT_XO);
-  si5351.set_freq(vfofreq*100, SI5351_CLK0);
+  set_plan();
 }
 
 #define T0CTC      0x02   // CTC mode
 #define T064PRE    0x03   // prescale by 64
 #define T0ON       0x02   // interrupt on
+#define T0KEY      0x04   // compare B interrupt on
+#define T0KEYOCR   124    // keyer tick count value
 
 // initialize timer 0
 void init_timer0() {
@@ -913,6 +1430,13 @@ void init_timer0() {
   TIMSK0 = T0ON;          // start timer 0
 }
 
+// start the keyer tick, half way through each
+// millisecond so it does not stack on msTimer
+void init_keyer() {
+  OCR0B  = T0KEYOCR;      // keyer tick count value
+  TIMSK0 |= T0KEY;        // start the keyer tick
+}
+
 #define T1ON       0x82   // OC1A PWM on
 #define T1OFF      0x00   // PWM off
 #define T1PRE      0x19   // prescale by  1
@@ -986,6 +1510,8 @@ void init_pins() {
 // initialize the I2C bus
 void init_i2c() {
   i2c.begin();
+  // Si5351 keying writes go ahead of OLED traffic
+  i2c.priority(SI5351_I2C_ADDR);
 }
 
 // initialize the serial port
@@ -1011,11 +1537,12 @@ void init_check() {
 
 // rotary encoder init
 void init_encoder() {
-  // interrupt-enable for ROTA, ROTB pin changes
-  PCMSK2 = (1 << PCINT20) | (1 << PCINT18);
+  // interrupt-enable for ROTA, ROTB, DIT, DAH pin changes
+  pcpins = PIND;
+  PCMSK2 = (1 << PCINT23) | (1 << PCINT22) | (1 << PCINT20) | (1 << PCINT18);
   PCICR  = (1 << PCIE2);
-  enc_a = digitalRead(ROTA);
-  enc_b = digitalRead(ROTB);
+  enc_a = PinRotA::read();
+  enc_b = PinRotB::read();
   enc_state = (enc_b << 1) | enc_a;
   interrupts();
 }
@@ -1070,23 +1597,30 @@ void set_oled_timeout() {
   }
 }
 
-// set the Rx/Tx status
+// set the Rx/Tx status, the Tx clock
+// follows on the next keyer tick
 void set_tx_status(uint8_t tx) {
   if (tx) {
     tx_status = ON;
-    digitalWrite(TXLED,  ON);
-    digitalWrite(KEYOUT, ON);
-    si5351.output_enable(SI5351_CLK0, ON);   // Tx on
-//  si5351.output_enable(SI5351_CLK1, OFF);  // Rx off
+    PinTxLed::high();
+    PinKeyOut::high();
   } else {
     tx_status = OFF;
-    digitalWrite(TXLED, OFF);
-    digitalWrite(KEYOUT,OFF);
-    si5351.output_enable(SI5351_CLK0, OFF);  // Tx off
-//  si5351.output_enable(SI5351_CLK1, ON);   // Rx on
+    PinTxLed::low();
+    PinKeyOut::low();
   }
 }
 
+// switch the Tx clock to follow the key, only the keyer
+// tick posts it so it never waits for the bus, when the
+// Si5351 lane is full it is left for the next tick
+void key_clk() {
+  if ((txclk == tx_status) || !i2c.room(SI5351_I2C_ADDR)) return;
+  txclk = tx_status;
+  si5351.output_enable(SI5351_CLK0, txclk);   // Tx on/off
+//si5351.output_enable(SI5351_CLK1, !txclk);  // Rx off/on
+}
+
 // frequency to band
 void freq2band(uint32_t freq) {
   if ((freq > 50000000) && (freq < 54000000)) {
@@ -1114,31 +1648,126 @@ void freq2band(uint32_t freq) {
   }
 }
 
-// update display with band and vfo frequency
+// tune a clock in the selected tuning mode, PLL
+// tuning moves every clock on PLLA
+void set_vfo(uint32_t freq, uint8_t clk) {
+  if (plltune) {
+    si5351.set_freq_pll(freq*100ULL, clk);
+    return;
+  }
+  uint16_t misses = si5351.cache_misses;
+  uint32_t t0 = us_time();
+  si5351.set_freq(freq*100ULL, clk);
+  t0 = us_time() - t0;
+  if (si5351.cache_misses != misses) {
+    miss_n++;
+    miss_us += t0;
+  } else {
+    hit_n++;
+    hit_us += t0;
+  }
+}
+
+// program the Rx (CLK1) and Tx (CLK0) clocks whenever a
+// frequency changes, key-down then only enables CLK0, in
+// PLL tuning the Tx clock is a fraction of the moved PLLA
+void set_plan() {
+  uint32_t rxfreq = vfofreq;
+  uint32_t txfreq = (split ? vfobfreq : vfofreq) + txoffset;
+  int32_t rit = (ritxit & RIT_ON) ? ritofs : 0;
+  int32_t xit = (ritxit & XIT_ON) ? ritofs : 0;
+  set_vfo(rxfreq + rit, SI5351_CLK1);
+  if (plltune) si5351.set_freq((txfreq + xit)*100ULL, SI5351_CLK0);
+  else set_vfo(txfreq + xit, SI5351_CLK0);
+  // the parked sets were for the old frequencies
+  si5351.unpark(PARK_RX);
+  si5351.unpark(PARK_TX);
+}
+
+// park the other RIT and XIT states for set_ritxit(), only
+// when the offset or the RIT/XIT state changes, so a plain
+// retune does no extra math and leaves the cache alone
+void park_ritxit() {
+  uint32_t rxfreq = vfofreq;
+  uint32_t txfreq = (split ? vfobfreq : vfofreq) + txoffset;
+  int32_t rit = (ritxit & RIT_ON) ? ritofs : 0;
+  int32_t xit = (ritxit & XIT_ON) ? ritofs : 0;
+  si5351.park(PARK_RX, (rxfreq + (ritofs - rit))*100ULL, SI5351_CLK1);
+  si5351.park(PARK_TX, (txfreq + (ritofs - xit))*100ULL, SI5351_CLK0);
+}
+
+// switch RIT and XIT, each clock that changes swaps in its
+// parked set with one burst, no math on the key-down path,
+// after a retune the sets are built here on the first switch
+void set_ritxit(uint8_t mode) {
+  uint8_t changed = ritxit ^ mode;
+  ritxit = mode;
+  if (((changed & RIT_ON) && !si5351.swap(PARK_RX)) ||
+      ((changed & XIT_ON) && !si5351.swap(PARK_TX))) {
+    set_plan();
+    park_ritxit();
+  }
+}
+
+// set the RIT/XIT offset
+void set_ritofs(int32_t ofs) {
+  if (ofs >  RIT_MAX) ofs =  RIT_MAX;
+  if (ofs < -RIT_MAX) ofs = -RIT_MAX;
+  ritofs = ofs;
+  set_plan();
+  park_ritxit();
+}
+
+// set the Tx offset, it is kept in the eeprom
+// at once so it survives a power cycle
+void set_txoffset(int32_t ofs) {
+  if (ofs >  TXOFS_MAX) ofs =  TXOFS_MAX;
+  if (ofs < -TXOFS_MAX) ofs = -TXOFS_MAX;
+  if (ofs == txoffset) return;
+  txoffset = ofs;
+  eeprom.put32(TXOFS_ADDR, txoffset);
+  set_plan();
+}
+
+// update the band and vfo frequency, the display is
+// redrawn later by run_display()
 void update_display() {
   freq2band(vfofreq);
-  si5351.set_freq(vfofreq*100, SI5351_CLK1);
-  oled.printline(0, band_label[radioband]);
+  set_plan();
+  if (!dispjobs) dispstamp = msTimer;
+  dispjobs |= JOB_VFO;
+}
+
+// draw the band and vfo frequency, the top line is
+// built in one piece so only changed cells redraw
+void draw_vfo() {
+  char row[17];
+  uint32_t t0 = us_time();
+  cpystr(row, (char *)band_label[radioband]);
   if (keyermode) {
-    oled.setCursor(9,0);
+    while (len(row) < 9) catc(row, ' ');
     switch (keyermode) {
       case IAMBICA:
-        oled.putstr("IA");
+        catstr(row, "IA");
         break;
       case IAMBICB:
-        oled.putstr("IB");
+        catstr(row, "IB");
         break;
       case ULTIMATIC:
-        oled.putstr("UM");
+        catstr(row, "UM");
         break;
       default:
         break;
     }
-    oled.setCursor(12,0);
-    oled.print8(keyerwpm);
+    while (len(row) < 12) catc(row, ' ');
+    catc(row, '0' + (keyerwpm / 10));
+    catc(row, '0' + (keyerwpm % 10));
   }
+  oled.printline(0, row);
   oled.print32(vfofreq);
   stepsize_cursor();
+  t0 = us_time() - t0;
+  if (t0 > stall_max) stall_max = t0;
 }
 
 // check for display timeout
@@ -1163,9 +1792,14 @@ void check_UI() {
       return;
     }
   }
-  // check for key/paddle input
-  if (keyermode) iambic_keyer();
-  else straight_key();
+  // paddle input seen by the keyer tick
+  if (keywake) {
+    keywake = NO;
+    reset_xtimer();
+  }
+  // check for straight key input, the
+  // iambic keyer runs in the keyer tick
+  if (!keyermode) straight_key();
   // check for pushbutton input
   if (SW1_PRESSED) {
     reset_xtimer();
@@ -1274,6 +1908,7 @@ void exit_menu() {
   menumode = NOT_IN_MENU;
   enc_val = 0;
   update_display();
+  dispjobs |= JOB_CW;
 }
 
 // menu actions
@@ -1283,7 +1918,7 @@ void menuAction(uint8_t id) {
     //   id                          variable    label         min max
     //   ---------                   --------    -------       --- ---
     case VOLUME:     paramAction(id, &volume,    NULL,         0,   6); break;
-    case KEYERWPM:   paramAction(id, &keyerwpm,  NULL,         10, 60); break;
+    case KEYERWPM:   paramAction(id, &keyerwpm,  NULL, MINWPM, MAXWPM); break;
     case RADIOBAND:  paramAction(id, &radioband, band_label,   0,  10); break;
     case CWTONE:     paramAction(id, &cwtone,    cwtone_label, 0,   1); break;
     case DXBLANK:    paramAction(id, &dxblank,   dxbk_label,   0,   2); break;
@@ -1291,6 +1926,8 @@ void menuAction(uint8_t id) {
     case SAVE2EE:    paramAction(id, &save2ee,   onoff_label,  0,   1); break;
     case KEYERMODE:  paramAction(id, &keyermode, keyer_label,  0,   3); break;
     case KEYSWAP:    paramAction(id, &keyswap,   onoff_label,  0,   1); break;
+    case RITXIT:     paramAction(id, &ritxit,    ritxit_label, 0,   3); break;
+    case RITOFS:     paramAction(id, &ritstep,   NULL,         0, 200); break;
     case SWVER:      paramAction(id, NULL,       NULL,         0,   1); break;
 
     default: break;
@@ -1299,7 +1936,15 @@ void menuAction(uint8_t id) {
 
 // parameters actions
 void paramAction(uint8_t id, uint8_t* ptr, const char* sap[], uint8_t min, uint8_t max) {
+  if (id == RITOFS) {
+    // the offset is edited in 10 Hz steps
+    int16_t n = ritofs / 10;
+    if (n < -RIT_MENU) n = -RIT_MENU;
+    if (n >  RIT_MENU) n =  RIT_MENU;
+    ritstep = n + RIT_MENU;
+  }
   uint8_t value = *ptr;
+  uint8_t prev = value;
   int16_t newvalue;
   switch (menumode) {
     case SELECT_MENU:
@@ -1315,7 +1960,8 @@ void paramAction(uint8_t id, uint8_t* ptr, const char* sap[], uint8_t min, uint8
       else if (newvalue > max) value = max;
       else value = newvalue;
       enc_val = 0;
-      *ptr = value;
+      // RIT/XIT switches through set_ritxit()
+      if (id != RITXIT) *ptr = value;
       show_value(id, value, sap);
       // parameter-specific actions
       switch (id) {
@@ -1332,6 +1978,12 @@ void paramAction(uint8_t id, uint8_t* ptr, const char* sap[], uint8_t min, uint8
         case DXBLANK:
           set_oled_timeout();
           break;
+        case RITXIT:
+          set_ritxit(value);
+          break;
+        case RITOFS:
+          if (value != prev) set_ritofs(((int16_t)value - RIT_MENU) * 10);
+          break;
         default:
           break;
       }
@@ -1357,6 +2009,21 @@ void show_value (uint8_t id, uint8_t val, const char* sap[]) {
     case SWVER:
       oled.printline(1, VERSION);
       break;
+    case RITOFS:
+      // signed offset in Hz
+      {
+        char tmp[16];
+        int16_t ofs = ((int16_t)val - RIT_MENU) * 10;
+        cpystr(tmp, (char *)((ofs < 0) ? "-" : "+"));
+        if (ofs < 0) ofs = -ofs;
+        for (int16_t d = 1000; d > 1; d /= 10) {
+          if (ofs >= d) catc(tmp, '0' + (ofs / d) % 10);
+        }
+        catc(tmp, '0' + ofs % 10);
+        catstr(tmp, (char *)" Hz");
+        oled.printline(1, tmp);
+      }
+      break;
     default:
       if (sap == NULL) {
         oled.setCursor(0,1);
@@ -1392,6 +2059,11 @@ void do_reset(uint8_t soft) {
   Serial.print("  Reading EEPROM\r\n");
   vfofreq  = eeprom.get32(FREQ_ADDR);
   cal_data = eeprom.get32(DATA_ADDR);
+  txoffset = eeprom.get32(TXOFS_ADDR);
+  // an erased cell reads as -1
+  if ((txoffset == -1) || (txoffset > TXOFS_MAX) || (txoffset < -TXOFS_MAX)) {
+    txoffset = TXOFFSET;
+  }
   freq2band(vfofreq);
   if ((radioband == UNKNOWN) || (cal_data > CAL_DATA_MAX)) {
     soft = 0;
@@ -1406,11 +2078,14 @@ void do_reset(uint8_t soft) {
     wait_ms(ONE_SECOND);
     cal_data = CAL_DATA_INIT;
     vfofreq  = INITVFO;
+    txoffset = TXOFFSET;
     freq2band(vfofreq);
     save_eeprom();
   }
   catfreq  = vfofreq;
-  si5351.set_freq(vfofreq*100, SI5351_CLK1);
+  vfobfreq = vfofreq;
+  split    = OFF;
+  set_plan();
   show_cal();
   set_tx_status(OFF);
 }
@@ -1439,8 +2114,12 @@ void run_calibrate() {
   // print to OLED
   oled.clrScreen();
   oled.putstr("CALIBRATION MODE");
+  // hold the keyer tick while the
+  // calibration clock owns the outputs
+  TIMSK0 &= ~T0KEY;
   // update the VFO
   si5351.output_enable(SI5351_CLK0, OFF);  // Tx off
+  txclk = OFF;
   si5351.output_enable(SI5351_CLK1, OFF);  // Rx off
   si5351.set_freq(CAL_FREQ, SI5351_CLK2);
   si5351.set_clock_pwr(SI5351_CLK2, ON);
@@ -1484,6 +2163,7 @@ void run_calibrate() {
   }
   si5351.output_enable(SI5351_CLK2, OFF);
   si5351.set_clock_pwr(SI5351_CLK2, OFF);
+  TIMSK0 |= T0KEY;
   // print to serial port
   Serial.print("\r\n\  Exiting Calibration Mode\r\n");
   show_cal();
@@ -1495,6 +2175,38 @@ void run_calibrate() {
   }
   wait_ms(TWO_SECONDS);
   update_display();
+  dispjobs |= JOB_CW;
+}
+
+// print the PLL and multisynth every band frequency gets
+// on the Rx clock, and the calibration output's allocation
+void show_plan() {
+  uint8_t band = radioband;
+  for (uint8_t i=0; i<(sizeof(bandfreq)/sizeof(bandfreq[0])); i++) {
+    freq2band(bandfreq[i]);
+    show_alloc(band_label[radioband], bandfreq[i]*100ULL, SI5351_CLK1);
+  }
+  radioband = band;
+  show_alloc("CAL", CAL_FREQ, SI5351_CLK2);
+  Serial.print("\r\n");
+}
+
+// print one clock allocation
+void show_alloc(const char *label, uint64_t freq, uint8_t clk) {
+  struct Si5351Plan p;
+  si5351.plan(freq, clk, plltune && (clk == SI5351_CLK1), &p);
+  Serial.print("  ");
+  Serial.print(label);
+  Serial.print("  ");
+  Serial.print((uint32_t)(freq / 100));
+  Serial.print((p.pll == SI5351_PLLB) ? "  PLLB " : "  PLLA ");
+  Serial.print((uint32_t)(p.pll_freq / 100));
+  Serial.print("  MS ");
+  Serial.print(p.ms_a);
+  Serial.print(p.integer ? " int" : " frac");
+  Serial.print("  R");
+  Serial.print(1 << p.r_div);
+  Serial.print("\r\n");
 }
 
 // table lookup for CW decoder
@@ -1504,14 +2216,18 @@ char lookup_cw(uint8_t addr) {
   return ch;
 }
 
-uint8_t cwcol = 0;
-uint8_t cwrow = 2;
+// decoded text history, the last two lines are shown
+// in the scrolling rows 2-3 of the display
+#define CWHIST  4            // lines of history (power of 2)
+char    cwhist[CWHIST][17];
+uint8_t cwline = 0;          // line being decoded
+uint8_t cwcol  = 0;
 
-// convert morse to ascii and print
-void print_cw() {
-  oled.setCursor(cwcol,cwrow);
-  char ch = lookup_cw(maddr);
-  switch (maddr) {
+// convert morse to ascii and print it on the bottom
+// line, a full line scrolls up to make room
+void print_cw(uint8_t addr) {
+  char ch = lookup_cw(addr);
+  switch (addr) {
     case 0xc5:
       // oled.putstr("<BK>");
       break;
@@ -1520,36 +2236,52 @@ void print_cw() {
       break;
     default:
       // clear screen if 8-dit code is received
-      if (!maddr) {
+      if (!addr) {
         oled.clrLine(2);
         oled.clrLine(3);
+        for (uint8_t i=0; i<CWHIST; i++) cwhist[i][0] = '\0';
         cwcol = 0;
-        cwrow = 2;
       } else {
-        oled.putch(ch);
-        cwcol++;
         if (cwcol > 15) {
+          // start a new line
+          cwline = (cwline + 1) & (CWHIST-1);
+          cwhist[cwline][0] = '\0';
           cwcol = 0;
-          if (cwrow == 2) {
-            cwrow = 3;
-            oled.clrLine(3);
-          } else {
-            cwrow = 2;
-            oled.clrLine(2);
-          }
+          oled.scroll();
+          oled.clrLine(3);
+          stepsize_cursor();
         }
+        oled.setCursor(cwcol,3);
+        oled.putch(ch);
+        cwhist[cwline][cwcol++] = ch;
+        cwhist[cwline][cwcol] = '\0';
       }
       if (recordMsg) catc(tmpstr, ch);
       break;
   }
 }
 
+// redraw the decoded text from the history
+void show_cw() {
+  oled.printline(2, cwhist[(cwline - 1) & (CWHIST-1)]);
+  oled.printline(3, cwhist[cwline]);
+}
+
+// queue morse for printing, called from the keyer
+// tick, when the queue is full the symbol is dropped
+void post_cw(uint8_t addr) {
+  uint8_t next = (cwqhead + 1) & CWQMASK;
+  if (next == cwqtail) return;
+  cwq[cwqhead] = addr;
+  cwqhead = next;
+}
+
 // update the morse code table address
 void maddr_cmd(uint8_t cmd) {
   if (cmd == 2) {
     // print the translated ascii
     // and reset the table address
-    print_cw();
+    post_cw(maddr);
     maddr = 1;
   }
   else {
@@ -1578,6 +2310,10 @@ void maddr_cmd(uint8_t cmd) {
 #define IDD_WAIT    3
 #define LTR_GAP     4
 #define WORD_GAP    5
+#define SEND_ELEM   6        // sending a buffered dit/dah
+#define SEND_IES    7        // space after a buffered dit/dah
+#define SEND_GAP    8        // letter or word space in buffered text
+#define SEND_STOP   9        // space after buffered text was cut off
 
 // more key info
 #define GOTDIT  (keyerinfo & DIT_REG)
@@ -1586,40 +2322,96 @@ void maddr_cmd(uint8_t cmd) {
 #define NOKEY   !GOTKEY
 #define GOTBOTH  GOTKEY == KEY_REG
 
-uint8_t  keyerstate = KEY_IDLE;
+volatile uint8_t keyerstate = KEY_IDLE;
 uint8_t  keyerinfo  = 0;
 
-// read and debounce paddles
+// read the paddles, a paddle is down while its integrator
+// is charged or when a press was latched since last time
 void read_paddles() {
-  uint8_t ditv1 = !digitalRead(DIT);
-  uint8_t dahv1 = !digitalRead(DAH);
-  uint8_t ditv2 = !digitalRead(DIT);
-  uint8_t dahv2 = !digitalRead(DAH);
-  if (ditv1 && ditv2) {
+  uint8_t sreg = SREG;
+  cli();
+  uint8_t pads = padlatch;
+  padlatch = 0;
+  if (ditint) pads |= DIT_PIN;
+  if (dahint) pads |= DAH_PIN;
+  SREG = sreg;
+  if (pads & DIT_PIN) {
     if (keyswap) keyerinfo |= DAH_REG;
     else keyerinfo |= DIT_REG;
   }
-  if (dahv1 && dahv2) {
+  if (pads & DAH_PIN) {
     if (keyswap) keyerinfo |= DIT_REG;
     else keyerinfo |= DAH_REG;
   }
   if (GOTBOTH) keyerinfo |= SQUEEZE;
   else keyerinfo &= ~SQUEEZE;
-  if (GOTKEY) reset_xtimer();
+  if (GOTKEY) keywake = YES;
+}
+
+// start timing an element or gap of t counts
+void key_time(uint32_t t) {
+  kdue = t0_time() + t;
+}
+
+// time the next element or gap from the end
+// of the last one, so latency never adds up
+void key_next(uint32_t t) {
+  kdue += t;
+}
+
+// true when the element or gap has ended
+uint8_t key_due() {
+  return((int32_t)(t0_time() - kdue) >= 0);
 }
 
-// iambic keyer state machine
+// move the next keyer tick to the end of the element
+// or gap when that comes before the regular 1 ms tick,
+// when it is too close to schedule wait for it here
+// and return true to run the keyer again, every tick
+// puts the compare point back to the regular phase
+// first so a moved tick never carries over
+uint8_t key_sched() {
+  int32_t left;
+  uint16_t tc;
+  OCR0B = T0KEYOCR;
+  if (keyerstate == KEY_IDLE) return(NO);
+  left = kdue - t0_time();
+  if (left > T0COUNTS) return(NO);
+  if (left <= KEY_SOON) {
+    while (!key_due());
+    return(YES);
+  }
+  tc = t0_tc + left;
+  if (tc >= T0COUNTS) tc -= T0COUNTS;
+  OCR0B = tc;
+  return(NO);
+}
+
+// record how late an element or gap ended (us)
+void key_jitter() {
+  int32_t late = (int32_t)(t0_time() - kdue) << 2;
+  if (late < jit_min) jit_min = late;
+  if (late > jit_max) jit_max = late;
+}
+
+// iambic keyer state machine, one step per keyer tick
 void iambic_keyer() {
-  static uint32_t ktimer;
   uint8_t send_dit = NO;
   uint8_t send_dah = NO;
   switch (keyerstate) {
     case KEY_IDLE:
       read_paddles();
       if (GOTKEY) {
-        keyerstate = CHK_KEY;
+        // the paddles win over buffered text
+        kytail = kyhead;
+        keyerstate = keyermode ? CHK_KEY : KEY_IDLE;
       } else {
         keyerinfo = 0;
+        // send buffered text
+        if (kytail != kyhead) {
+          kdue = t0_time();
+          ky_char();
+        }
       }
       break;
     case CHK_KEY:
@@ -1648,12 +2440,12 @@ void iambic_keyer() {
         }
       }
       if (send_dit) {
-        ktimer = msTimer + dittime;
+        key_time(dittime);
         maddr_cmd(0);
         keyerstate = KEY_WAIT;
       }
       else if (send_dah) {
-        ktimer = msTimer + dahtime;
+        key_time(dahtime);
         maddr_cmd(1);
         keyerstate = KEY_WAIT;
       }
@@ -1661,23 +2453,25 @@ void iambic_keyer() {
       break;
     case KEY_WAIT:
       // wait dit/dah duration
-      if (msTimer > ktimer) {
+      if (key_due()) {
         // done sending dit/dah
         set_tx_status(OFF);
+        key_jitter();
         // inter-symbol time is 1 dit
-        ktimer = msTimer + dittime;
+        key_next(dittime);
         keyerstate = IDD_WAIT;
       }
       break;
     case IDD_WAIT:
       // wait time between dit/dah
-      if (msTimer > ktimer) {
+      if (key_due()) {
         // wait done
+        key_jitter();
         keyerinfo &= ~KEY_REG;
         if ((keyermode == IAMBICA) || (keyermode == ULTIMATIC)) {
           // Iambic A or Ultimatic
           // check for letter space
-          ktimer = msTimer + lettergap1;
+          key_next(lettergap1);
           keyerstate = LTR_GAP;
         } else {
           // Iambic B
@@ -1686,30 +2480,30 @@ void iambic_keyer() {
             // send opposite of last paddle sent
             if (keyerinfo & WAS_DIT) {
               // send a dah
-              ktimer = msTimer + dahtime;
+              key_next(dahtime);
               maddr_cmd(1);
             }
             else {
               // send a dit
-              ktimer = msTimer + dittime;
+              key_next(dittime);
               maddr_cmd(0);
             }
             keyerinfo = 0;
             keyerstate = KEY_WAIT;
           } else {
             // check for letter space
-            ktimer = msTimer + lettergap1;
+            key_next(lettergap1);
             keyerstate = LTR_GAP;
           }
         }
       }
       break;
     case LTR_GAP:
-      if (msTimer > ktimer) {
+      if (key_due()) {
         // letter space found so print char
         maddr_cmd(2);
         // check for word space
-        ktimer = msTimer + wordgap1;
+        key_next(wordgap1);
         keyerstate = WORD_GAP;
       }
       read_paddles();
@@ -1720,10 +2514,10 @@ void iambic_keyer() {
       }
       break;
     case WORD_GAP:
-      if (msTimer > ktimer) {
+      if (key_due()) {
         // word gap found so print a space
         maddr = 1;
-        print_cw();
+        post_cw(maddr);
         keyerstate = KEY_IDLE;
       }
       read_paddles();
@@ -1733,21 +2527,214 @@ void iambic_keyer() {
         keyerinfo = 0;
       }
       break;
+    case SEND_ELEM:
+      if (ky_stop()) break;
+      if (key_due()) {
+        // done sending a buffered dit/dah
+        set_tx_status(OFF);
+        key_jitter();
+        key_next(dittime);
+        keyerstate = SEND_IES;
+      }
+      break;
+    case SEND_IES:
+      if (ky_stop()) break;
+      if (key_due()) {
+        if (kyn) {
+          ky_elem();
+        } else {
+          // character sent so print it
+          // and finish the letter space
+          maddr_cmd(2);
+          key_next(lettergap2 - dittime);
+          keyerstate = SEND_GAP;
+        }
+      }
+      break;
+    case SEND_GAP:
+      if (ky_stop()) break;
+      if (key_due() && !ky_char()) keyerstate = KEY_IDLE;
+      break;
+    case SEND_STOP:
+      // finish the space, then the paddles
+      read_paddles();
+      if (key_due()) keyerstate = keyermode ? CHK_KEY : KEY_IDLE;
+      break;
     default:
       break;
   }
 }
 
+// one keyer tick, the state machine runs until it
+// settles so the next element starts on the tick
+// that ends the last one
+void key_tick() {
+  uint8_t state;
+  uint8_t n;
+  do {
+    for (n = 0; n < 4; n++) {
+      // buffered text is sent in any keyer mode
+      if (!keyermode && (keyerstate == KEY_IDLE) && (kytail == kyhead)) break;
+      state = keyerstate;
+      iambic_keyer();
+      if (keyerstate == state) break;
+    }
+    key_clk();
+  } while (key_sched());
+}
+
+// sample the paddles every ms from compare A, an open
+// contact drains the integrator one step, so the paddle
+// reads up PAD_INT ms after the contact last closed
+void pad_debounce() {
+  uint8_t pins = PIND;
+  if ((pins & DIT_PIN) && ditint) ditint--;
+  if ((pins & DAH_PIN) && dahint) dahint--;
+  pad_sample(DIT_PIN, !(pins & DIT_PIN), &ditcnt, &ditint);
+  pad_sample(DAH_PIN, !(pins & DAH_PIN), &dahcnt, &dahint);
+}
+
 // handle straight key mode
 void straight_key() {
+  uint8_t sreg = SREG;
+  uint8_t down;
+  cli();
+  // the keyer tick owns the key and keyerinfo
+  // while it sends buffered text
+  if (keyerstate != KEY_IDLE) {
+    SREG = sreg;
+    return;
+  }
   keyerinfo = 0;
   read_paddles();
-  if (GOTDIT) {
-    reset_xtimer();
-    set_tx_status(ON);
+  down = GOTDIT;
+  set_tx_status(down ? ON : OFF);
+  SREG = sreg;
+  if (down) reset_xtimer();
+}
+
+// queue a character for the CW sender, lower case is
+// sent as upper case and anything without a code dropped,
+// a2m[] fills the gaps with the code for '?'
+void ky_put(char ch) {
+  uint8_t next = (kyhead + 1) & KYMASK;
+  if ((ch >= 'a') && (ch <= 'z')) ch -= 32;
+  if ((ch < ' ') || (ch > '_') || (next == kytail)) return;
+  if ((ch != '?') && (pgm_read_byte(a2m + (ch - ' ')) == A2M_NONE)) return;
+  kybuf[kyhead] = ch;
+  kyhead = next;
+}
+
+// free space in the CW send buffer
+uint8_t ky_room() {
+  return((kytail - kyhead - 1) & KYMASK);
+}
+
+// take the next buffered character and load its code,
+// a run of spaces is one word space, the codes in a2m[]
+// are a leading 1 then the elements MSB first, 1 = dah
+uint8_t ky_next() {
+  uint8_t code;
+  char ch;
+  if (kytail == kyhead) return(NO);
+  ch = kybuf[kytail];
+  kytail = (kytail + 1) & KYMASK;
+  while ((ch == ' ') && (kytail != kyhead) && (kybuf[kytail] == ' ')) {
+    kytail = (kytail + 1) & KYMASK;
+  }
+  code = pgm_read_byte(a2m + (ch - ' '));
+  kyn = 7;
+  while (!(code & 0x80)) {
+    code <<= 1;
+    kyn--;
+  }
+  kysym = code << 1;
+  return(YES);
+}
+
+// start the next buffered character after a letter space,
+// a space extends it to a word space, returns NO when
+// the buffer is empty
+uint8_t ky_char() {
+  if (!ky_next()) return(NO);
+  if (kyn) {
+    ky_elem();
   } else {
+    // print the space, 7 dits with the letter space
+    maddr = 1;
+    post_cw(maddr);
+    key_next(wordgap2 - lettergap2);
+    keyerstate = SEND_GAP;
+  }
+  return(YES);
+}
+
+// send the next element of the buffered character,
+// timed from the end of the last element or space
+void ky_elem() {
+  if (kysym & 0x80) {
+    key_next(dahtime);
+    maddr_cmd(1);
+  } else {
+    key_next(dittime);
+    maddr_cmd(0);
+  }
+  kysym <<= 1;
+  kyn--;
+  keyerstate = SEND_ELEM;
+}
+
+// paddle input stops the buffered text at once and
+// hands the key back to the paddles, a cut off element
+// or space is followed by a full element space
+uint8_t ky_stop() {
+  read_paddles();
+  if (!GOTKEY) return(NO);
+  kytail = kyhead;
+  maddr = 1;
+  if (keyerstate == SEND_GAP) {
+    keyerstate = keyermode ? CHK_KEY : KEY_IDLE;
+    return(YES);
+  }
+  if (keyerstate == SEND_ELEM) {
     set_tx_status(OFF);
+    key_time(dittime);
+  }
+  keyerstate = SEND_STOP;
+  return(YES);
+}
+
+// true when the keyer is not sending an element
+// or timing the gap between two elements
+uint8_t key_gap() {
+  if (!keyermode) return(!tx_status);
+  return((keyerstate == KEY_IDLE) || (keyerstate == LTR_GAP) ||
+         (keyerstate == WORD_GAP) || (keyerstate == SEND_GAP));
+}
+
+// run one display job per pass of the main loop, jobs
+// wait for a key-up gap so the OLED never stretches an
+// element, and for room in the I2C queue so they never
+// block on the bus
+void run_display() {
+  if ((cwqhead == cwqtail) && !(dispjobs && !menumode)) {
+    // nothing waiting, a new symbol waits from now
+    if (!dispjobs) dispstamp = msTimer;
+    return;
+  }
+  if (!key_gap() && ((msTimer - dispstamp) < DISP_MAXWAIT)) return;
+  if (i2c.busy() > (I2C_QLEN/2)) return;
+  if (cwqhead != cwqtail) {
+    print_cw(cwq[cwqtail]);
+    cwqtail = (cwqtail + 1) & CWQMASK;
+  } else if (dispjobs & JOB_VFO) {
+    dispjobs &= ~JOB_VFO;
+    draw_vfo();
+  } else {
+    dispjobs &= ~JOB_CW;
+    show_cw();
   }
+  dispstamp = msTimer;
 }
 
 // main code starts here
@@ -1768,6 +2755,7 @@ int main() {
   init_oled();
   init_wpm();
   init_freq();
+  init_keyer();
   update_display();
 
   // main loop
@@ -1775,6 +2763,7 @@ int main() {
     check_CAT();      // check CAT interface
     check_UI();       // check UI pushbutton
     check_menu();     // check for menu ops
+    run_display();    // drain display jobs
   }
   return 0;
 }
@@ -5,7 +5,7 @@
 #define FONT_W 8
 #define FONT_H 2
 
-const uint8_t font[] PROGMEM = {
+constexpr uint8_t font[] PROGMEM = {
 
    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, // SPACE
    0x00, 0x00, 0x5f, 0x5f, 0x00, 0x00, 0x00, 0x00, // !
@@ -15,140 +15,387 @@ I2C::I2C() {
 // Public Methods
 
 void I2C::begin() {
+  if (stuck) recover();
+  stuck = 0;
   sbi(PORTC, 4);
   sbi(PORTC, 5);
   cbi(TWSR, TWPS0);
   cbi(TWSR, TWPS1);
   TWBR = ((F_CPU / 400000) - 16) / 2;
+  head = 0;
+  tail = 0;
+  hhead = 0;
+  htail = 0;
+  active = 0;
+  hi_wait = 0;
   TWCR = _BV(TWEN) | _BV(TWEA);
 }
 
 void I2C::end() {
+  flush();
   TWCR = 0;
 }
 
+// blocking write of a single byte
 void I2C::write(uint8_t address, uint8_t registerAddress, uint8_t data) {
-  start();
-  sendAddress(SLA_W(address));
-  sendByte(registerAddress);
-  sendByte(data);
-  stop();
+  volatile uint8_t done;
+  queue_txn(address, registerAddress, &data, 1, I2C_INLINE, &done);
+  wait(&done);
 }
 
+// blocking write of a buffer
 void I2C::write(uint8_t address, uint8_t registerAddress, uint8_t *data, uint8_t numberBytes) {
-  start();
-  sendAddress(SLA_W(address));
-  sendByte(registerAddress);
-  for (uint8_t i = 0; i < numberBytes; i++) sendByte(data[i]);
-  stop();
+  volatile uint8_t done;
+  queue_txn(address, registerAddress, data, numberBytes, 0, &done);
+  wait(&done);
 }
 
-void I2C::writezeros(uint8_t address, uint8_t registerAddress, uint8_t numberBytes) {
-  start();
-  sendAddress(SLA_W(address));
-  sendByte(registerAddress);
-  for (uint8_t i = 0; i < numberBytes; i++) sendByte(0);
-  stop();
+// blocking write of a buffer in flash
+void I2C::write_P(uint8_t address, uint8_t registerAddress, const uint8_t *data, uint8_t numberBytes) {
+  volatile uint8_t done;
+  queue_txn(address, registerAddress, data, numberBytes, I2C_PGM, &done);
+  wait(&done);
 }
 
-void I2C::writeones(uint8_t address, uint8_t registerAddress, uint8_t numberBytes) {
-  start();
-  sendAddress(SLA_W(address));
-  sendByte(registerAddress);
-  for (uint8_t i = 0; i < numberBytes; i++) sendByte(0xff);
-  stop();
+// blocking read of a single register
+uint8_t I2C::read(uint8_t address, uint8_t registerAddress) {
+  volatile uint8_t done;
+  uint8_t data = 0;
+  queue_txn(address, registerAddress, &data, 1, I2C_READ, &done);
+  wait(&done);
+  return(data);
 }
 
-void I2C::writecursor(uint8_t address, uint8_t registerAddress) {
-  start();
-  sendAddress(SLA_W(address));
-  sendByte(registerAddress);
-  for (uint8_t i = 0; i < 4; i++) sendByte(0x03);
-  stop();
+// blocking burst read of consecutive registers, the
+// master ACKs every byte but the last
+uint8_t I2C::read(uint8_t address, uint8_t registerAddress, uint8_t *data, uint8_t numberBytes) {
+  volatile uint8_t done;
+  queue_txn(address, registerAddress, data, numberBytes, I2C_READ, &done);
+  return(wait(&done));
 }
 
-uint8_t I2C::read(uint8_t address, uint8_t registerAddress) {
-  start();
-  sendAddress(SLA_W(address));
-  sendByte(registerAddress);
-  start();
-  sendAddress(SLA_R(address));
-  receiveByte();
-  stop();
-  return(TWDR);
+// queue a single byte write and return
+void I2C::post(uint8_t address, uint8_t registerAddress, uint8_t data) {
+  queue_txn(address, registerAddress, &data, 1, I2C_INLINE, NULL);
+}
+
+// queue a buffer write and return
+// short payloads are copied into the queue, longer ones must
+// stay valid until the completion flag leaves I2C_BUSY
+void I2C::post(uint8_t address, uint8_t registerAddress, uint8_t *data, uint8_t numberBytes, volatile uint8_t *done) {
+  uint8_t flags = (numberBytes <= I2C_INLINE_MAX) ? I2C_INLINE : 0;
+  queue_txn(address, registerAddress, data, numberBytes, flags, done);
+}
+
+// queue a write of n copies of a byte and return
+void I2C::postfill(uint8_t address, uint8_t registerAddress, uint8_t fill, uint8_t numberBytes) {
+  queue_txn(address, registerAddress, &fill, numberBytes, I2C_PATTERN, NULL);
+}
+
+// queue a write of n bytes of a repeating pattern and return,
+// the pattern is held in the queue entry so a pattern longer
+// than I2C_INLINE_MAX (or empty) is not sent
+void I2C::postpattern(uint8_t address, uint8_t registerAddress, uint8_t *pattern, uint8_t patternBytes, uint8_t numberBytes) {
+  if ((patternBytes == 0) || (patternBytes > I2C_INLINE_MAX)) return;
+  queue_txn(address, registerAddress, pattern, numberBytes, I2C_PATTERN, NULL, patternBytes);
+}
+
+// queue a write streamed from flash and return
+void I2C::post_P(uint8_t address, uint8_t registerAddress, const uint8_t *data, uint8_t numberBytes) {
+  queue_txn(address, registerAddress, data, numberBytes, I2C_PGM, NULL);
+}
+
+// queue a write whose bytes are produced on the fly and return
+void I2C::postgen(uint8_t address, uint8_t registerAddress, I2CGen gen, uint8_t arg, uint8_t numberBytes, volatile uint8_t *done) {
+  queue_txn(address, registerAddress, (const uint8_t*)gen, numberBytes, I2C_GEN, done, arg);
+}
+
+// route a device to the priority lane, its transactions
+// go ahead of anything queued on the normal lane
+void I2C::priority(uint8_t address) {
+  hiaddr = address;
+}
+
+// number of queued transactions
+uint8_t I2C::busy() {
+  return(((head - tail) & I2C_QMASK) + ((hhead - htail) & I2C_HQMASK));
+}
+
+// free entries on the lane a device's transactions go
+// to, a post with room returns without waiting
+uint8_t I2C::room(uint8_t address) {
+  if (address == hiaddr) return((htail - hhead - 1) & I2C_HQMASK);
+  return((tail - head - 1) & I2C_QMASK);
+}
+
+// bus bytes moved so far, wraps at 16 bits
+uint16_t I2C::count() {
+  uint8_t sreg = SREG;
+  cli();
+  uint16_t n = bytes;
+  SREG = sreg;
+  return(n);
+}
+
+// wait until all queued transactions are done
+void I2C::flush() {
+  uint16_t tc = 0;
+  uint16_t seen = bytes;
+  while (active) stalled(&tc, &seen);
+}
+
+// TWI state machine, one step per TWINT
+void I2C::isr() {
+  I2CTxn *t = cur;
+  bytes++;
+  switch (TWI_STATUS) {
+    case START:
+      // pick the next transaction, priority lane first
+      select();
+      t = cur;
+      if (t == &hqueue[htail]) {
+        if ((uint16_t)(bytes - hi_stamp) > hi_wait) hi_wait = bytes - hi_stamp;
+      }
+      idx = 0;
+      pidx = 0;
+      TWDR = SLA_W(t->addr);
+      TWCR = TWCR_NEXT;
+      break;
+    case REPEATED_START:
+      TWDR = SLA_R(t->addr);
+      TWCR = TWCR_NEXT;
+      break;
+    case MT_SLA_ACK:
+      TWDR = t->reg;
+      TWCR = TWCR_NEXT;
+      break;
+    case MT_DATA_ACK:
+      if (t->flags & I2C_READ) {
+        TWCR = TWCR_START;
+      } else if (idx < t->len) {
+        TWDR = payload(t);
+        idx++;
+        TWCR = TWCR_NEXT;
+      } else {
+        finish(I2C_OK);
+      }
+      break;
+    case MR_SLA_ACK:
+      TWCR = (t->len > 1) ? TWCR_ACK : TWCR_NEXT;
+      break;
+    case MR_DATA_ACK:
+      t->data[idx++] = TWDR;
+      TWCR = (idx < (t->len - 1)) ? TWCR_ACK : TWCR_NEXT;
+      break;
+    case MR_DATA_NACK:
+      t->data[idx] = TWDR;
+      finish(I2C_OK);
+      break;
+    case MT_SLA_NACK:
+    case MT_DATA_NACK:
+    case MR_SLA_NACK:
+      stat(t->addr)->nack++;
+      finish(TWI_STATUS);
+      break;
+    default:
+      // lost arbitration or bus error, TW_BUS_ERROR
+      // reads as 0x00 so it needs its own status
+      stat(t->addr)->buserr++;
+      fault(I2C_BUSERR);
+      break;
+  }
 }
 
 // Private Methods
 
-uint8_t I2C::start() {
-  TWCR = (1<<TWINT)|(1<<TWSTA)|(1<<TWEN);
-  while (!(TWCR & (1<<TWINT)));
-  if ((TWI_STATUS == START) || (TWI_STATUS == REPEATED_START)) {
-    return(0);
+// add a transaction to the queue and start the bus if idle
+void I2C::queue_txn(uint8_t address, uint8_t registerAddress, const uint8_t *data, uint8_t numberBytes, uint8_t flags, volatile uint8_t *done, uint8_t arg) {
+  uint8_t sreg;
+  uint8_t hi = (address == hiaddr);
+  uint16_t tc = 0;
+  uint16_t seen = bytes;
+  I2CTxn *t;
+  // a fault left the bus to be recovered, do that
+  // now unless posting from an interrupt handler
+  if (stuck && (SREG & _BV(SREG_I))) restart();
+  // wait for a free queue entry
+  while (1) {
+    sreg = SREG;
+    cli();
+    if (hi && (((hhead + 1) & I2C_HQMASK) != htail)) break;
+    if (!hi && (((head + 1) & I2C_QMASK) != tail)) break;
+    SREG = sreg;
+    stalled(&tc, &seen);
+  }
+  if (hi) {
+    if (hhead == htail) hi_stamp = bytes;
+    t = &hqueue[hhead];
+  } else {
+    t = &queue[head];
+  }
+  t->addr  = address;
+  t->reg   = registerAddress;
+  t->len   = numberBytes;
+  t->flags = flags;
+  t->arg   = arg;
+  t->data  = (uint8_t*)data;
+  t->done  = done;
+  if (flags & (I2C_INLINE | I2C_PATTERN)) {
+    uint8_t n = (flags & I2C_PATTERN) ? arg : numberBytes;
+    for (uint8_t i = 0; i < n; i++) t->buf[i] = data[i];
   }
-  if (TWI_STATUS == LOST_ARBTRTN) {
-    uint8_t bufferedStatus = TWI_STATUS;
-    lockUp();
-    return(bufferedStatus);
+  if (done) *done = I2C_BUSY;
+  if (hi) hhead = (hhead + 1) & I2C_HQMASK;
+  else head = (head + 1) & I2C_QMASK;
+  if (!active) {
+    active = 1;
+    select();
+    for (uint8_t n = 0; (TWCR & _BV(TWSTO)) && (n < 255); n++);
+    TWCR = TWCR_START;
   }
-  return(TWI_STATUS);
+  SREG = sreg;
+}
+
+// wait for a transaction to complete
+uint8_t I2C::wait(volatile uint8_t *done) {
+  uint16_t tc = 0;
+  uint16_t seen = bytes;
+  while (*done == I2C_BUSY) stalled(&tc, &seen);
+  return(*done);
 }
 
-uint8_t I2C::sendAddress(uint8_t i2cAddress) {
-  TWDR = i2cAddress;
-  TWCR = (1<<TWINT) | (1<<TWEN);
-  while (!(TWCR & (1<<TWINT)));
-  if ((TWI_STATUS == MT_SLA_ACK) || (TWI_STATUS == MR_SLA_ACK)) {
-    return(0);
+// count wait loops without bus progress, drop the
+// transaction on the bus when they run out and
+// recover the bus after a fault or a timeout
+uint8_t I2C::stalled(uint16_t *tc, uint16_t *seen) {
+  uint8_t ret = 0;
+  if (!stuck) {
+    if (*seen != bytes) {
+      *seen = bytes;
+      *tc = 0;
+      return(0);
+    }
+    if (++(*tc) < I2C_WAITMAX) return(0);
+    timeout();
+    ret = 1;
   }
-  uint8_t bufferedStatus = TWI_STATUS;
-  if ((TWI_STATUS == MT_SLA_NACK) || (TWI_STATUS == MR_SLA_NACK)) {
-    stop();
-    return(bufferedStatus);
-  } else {
-    lockUp();
-    return(bufferedStatus);
+  *tc = 0;
+  if (stuck) restart();
+  return(ret);
+}
+
+// next payload byte of a write
+uint8_t I2C::payload(I2CTxn *t) {
+  if (t->flags & I2C_PATTERN) {
+    uint8_t data = t->buf[pidx];
+    if (++pidx >= t->arg) pidx = 0;
+    return(data);
   }
+  if (t->flags & I2C_GEN) return(((I2CGen)t->data)(t->arg, idx));
+  if (t->flags & I2C_PGM) return(pgm_read_byte(t->data + idx));
+  if (t->flags & I2C_INLINE) return(t->buf[idx]);
+  return(t->data[idx]);
 }
 
-uint8_t I2C::sendByte(uint8_t i2cData) {
-  TWDR = i2cData;
-  TWCR = (1<<TWINT) | (1<<TWEN);
-  while (!(TWCR & (1<<TWINT)));
-  if (TWI_STATUS == MT_DATA_ACK) {
-    return(0);
+// statistics entry for a device, the last entry
+// collects any devices beyond I2C_NDEV
+I2CStats* I2C::stat(uint8_t address) {
+  uint8_t i;
+  for (i = 0; i < (I2C_NDEV - 1); i++) {
+    if (stats[i].addr == address) break;
+    if (stats[i].addr == 0) {
+      stats[i].addr = address;
+      break;
+    }
   }
-  uint8_t bufferedStatus = TWI_STATUS;
-  if (TWI_STATUS == MT_DATA_NACK) {
-    stop();
-    return(bufferedStatus);
+  return(&stats[i]);
+}
+
+// select the next transaction, priority lane first
+void I2C::select() {
+  if (hhead != htail) cur = &hqueue[htail];
+  else cur = &queue[tail];
+}
+
+// report status and remove the current transaction
+void I2C::complete(uint8_t status) {
+  if (cur->done) *cur->done = status;
+  if (cur == &hqueue[htail]) htail = (htail + 1) & I2C_HQMASK;
+  else tail = (tail + 1) & I2C_QMASK;
+}
+
+// complete the current transaction and start the next one
+void I2C::finish(uint8_t status) {
+  complete(status);
+  if ((head != tail) || (hhead != htail)) {
+    select();
+    TWCR = TWCR_RESTART;
   } else {
-    lockUp();
-    return(bufferedStatus);
+    TWCR = TWCR_STOP;
+    active = 0;
   }
 }
 
-uint8_t I2C::receiveByte() {
-  TWCR = (1<<TWINT) | (1<<TWEN);
-  while (!(TWCR & (1<<TWINT)));
-  if (TWI_STATUS == LOST_ARBTRTN) {
-    uint8_t bufferedStatus = TWI_STATUS;
-    lockUp();
-    return(bufferedStatus);
+// drop the current transaction after a bus fault or a
+// timeout, park the TWI and leave the bus recovery to
+// restart() so it never spins for ~100 us with
+// interrupts off
+void I2C::fault(uint8_t status) {
+  TWCR = 0;
+  complete(status);
+  stuck = 1;
+}
+
+// recover the bus after a fault and start the next
+// transaction, called with interrupts enabled
+void I2C::restart() {
+  recover();
+  uint8_t sreg = SREG;
+  cli();
+  stuck = 0;
+  if ((head != tail) || (hhead != htail)) {
+    select();
+    TWCR = TWCR_START;
+  } else {
+    active = 0;
   }
-  return(TWI_STATUS);
+  SREG = sreg;
 }
 
-uint8_t I2C::stop() {
-  TWCR = (1<<TWINT)|(1<<TWEN)| (1<<TWSTO);
-  while ((TWCR & (1<<TWSTO)));
-  return(0);
+// a transaction made no progress
+void I2C::timeout() {
+  uint8_t sreg = SREG;
+  cli();
+  if (active && !stuck) {
+    stat(cur->addr)->timeout++;
+    fault(I2C_TIMEOUT);
+  }
+  SREG = sreg;
 }
 
-void I2C::lockUp() {
+// free a stuck bus: clock out nine SCL pulses so a slave
+// holding SDA can finish its byte, send a STOP and re-init
+void I2C::recover() {
+  stat(cur->addr)->recover++;
   TWCR = 0; //releases SDA and SCL lines to high impedance
+  for (uint8_t i = 0; i < 9; i++) {
+    cbi(PORTC, SCL_PIN);
+    sbi(DDRC,  SCL_PIN);
+    delayMicroseconds(5);
+    cbi(DDRC,  SCL_PIN);
+    sbi(PORTC, SCL_PIN);
+    delayMicroseconds(5);
+  }
+  cbi(PORTC, SDA_PIN);
+  sbi(DDRC,  SDA_PIN);
+  delayMicroseconds(5);
+  cbi(DDRC,  SDA_PIN);
+  sbi(PORTC, SDA_PIN);
+  delayMicroseconds(5);
   TWCR = _BV(TWEN) | _BV(TWEA); //reinitialize TWI
 }
 
-I2C I2c = I2C();
+ISR(TWI_vect) {
+  i2c.isr();
+}
 
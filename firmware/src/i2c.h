@@ -28,6 +28,65 @@
 #define cbi(sfr, bit)   (_SFR_BYTE(sfr) &= ~_BV(bit))
 #define sbi(sfr, bit)   (_SFR_BYTE(sfr) |= _BV(bit))
 
+// TWCR commands for the interrupt-driven engine
+#define TWCR_START      (_BV(TWINT) | _BV(TWSTA) | _BV(TWEN) | _BV(TWIE))
+#define TWCR_NEXT       (_BV(TWINT) | _BV(TWEN) | _BV(TWIE))
+#define TWCR_ACK        (_BV(TWINT) | _BV(TWEN) | _BV(TWIE) | _BV(TWEA))
+#define TWCR_STOP       (_BV(TWINT) | _BV(TWEN) | _BV(TWSTO))
+#define TWCR_RESTART    (TWCR_STOP  | _BV(TWSTA) | _BV(TWIE))
+
+// transaction queues
+#define I2C_QLEN        8         // normal lane depth (power of 2)
+#define I2C_QMASK       (I2C_QLEN-1)
+#define I2C_HQLEN       4         // priority lane depth (power of 2)
+#define I2C_HQMASK      (I2C_HQLEN-1)
+#define I2C_INLINE_MAX  6         // payload bytes held in the queue entry
+                                  // and longest repeating pattern
+
+// transaction flags
+#define I2C_INLINE      0x01      // payload is in the queue entry
+#define I2C_PATTERN     0x02      // repeat buf[0..arg-1] for len bytes
+#define I2C_READ        0x04      // register read with repeated start
+#define I2C_PGM         0x08      // payload is in flash (PROGMEM)
+#define I2C_GEN         0x10      // payload bytes come from a generator
+
+// transaction completion status
+#define I2C_OK          0x00
+#define I2C_TIMEOUT     0x01      // no bus progress, bus recovered
+#define I2C_BUSERR      0x02      // bus error or lost arbitration
+#define I2C_BUSY        0xFF
+
+// bus timeout and recovery
+#define I2C_WAITMAX     2000      // wait loops without bus progress
+#define I2C_NDEV        4         // devices with error statistics
+#define SDA_PIN         4         // PC4
+#define SCL_PIN         5         // PC5
+
+// payload generator, called from the TWI ISR with the
+// transaction argument and the index of each byte
+typedef uint8_t (*I2CGen)(uint8_t, uint8_t);
+
+// a queued bus transaction
+struct I2CTxn {
+  uint8_t  addr;                  // device address
+  uint8_t  reg;                   // register address
+  uint8_t  len;                   // payload length
+  uint8_t  flags;                 // transaction flags
+  uint8_t  arg;                   // pattern length or generator argument
+  uint8_t *data;                  // payload or read buffer
+  uint8_t  buf[I2C_INLINE_MAX];   // inline payload
+  volatile uint8_t *done;         // completion flag (or NULL)
+};
+
+// per-device error statistics
+struct I2CStats {
+  uint8_t  addr;                  // device address (0 = unused)
+  uint16_t nack;                  // address or data NACKs
+  uint16_t timeout;               // stalled transactions
+  uint16_t buserr;                // bus errors and lost arbitration
+  uint16_t recover;               // bus recoveries
+};
+
 class I2C {
   public:
     I2C();
@@ -35,21 +94,55 @@ class I2C {
     void end();
     void write(uint8_t, uint8_t, uint8_t);
     void write(uint8_t, uint8_t, uint8_t*, uint8_t);
-    void writezeros(uint8_t, uint8_t, uint8_t);
-    void writeones(uint8_t, uint8_t, uint8_t);
-    void writecursor(uint8_t, uint8_t);
+    void write_P(uint8_t, uint8_t, const uint8_t*, uint8_t);
     uint8_t read(uint8_t, uint8_t);
+    uint8_t read(uint8_t, uint8_t, uint8_t*, uint8_t);
+    void post(uint8_t, uint8_t, uint8_t);
+    void post(uint8_t, uint8_t, uint8_t*, uint8_t, volatile uint8_t* = NULL);
+    void postfill(uint8_t, uint8_t, uint8_t, uint8_t);
+    void postpattern(uint8_t, uint8_t, uint8_t*, uint8_t, uint8_t);
+    void post_P(uint8_t, uint8_t, const uint8_t*, uint8_t);
+    void postgen(uint8_t, uint8_t, I2CGen, uint8_t, uint8_t, volatile uint8_t* = NULL);
+    uint8_t wait(volatile uint8_t*);
+    void priority(uint8_t);
+    uint8_t busy();
+    uint8_t room(uint8_t);
+    uint16_t count();
+    void flush();
+    void isr();
+    // statistics
+    uint16_t hi_wait;             // worst-case priority wait (bus bytes)
+    I2CStats stats[I2C_NDEV];     // per-device error counts
 
   private:
-    uint8_t start();
-    uint8_t sendAddress(uint8_t);
-    uint8_t sendByte(uint8_t);
-    uint8_t receiveByte();
-    uint8_t stop();
-    void lockUp();
+    void queue_txn(uint8_t, uint8_t, const uint8_t*, uint8_t, uint8_t, volatile uint8_t*, uint8_t = 1);
+    uint8_t stalled(uint16_t*, uint16_t*);
+    uint8_t payload(I2CTxn*);
+    I2CStats* stat(uint8_t);
+    void select();
+    void complete(uint8_t);
+    void finish(uint8_t);
+    void fault(uint8_t);
+    void restart();
+    void timeout();
+    void recover();
+    I2CTxn queue[I2C_QLEN];       // normal lane
+    I2CTxn hqueue[I2C_HQLEN];     // priority lane
+    I2CTxn *cur;                  // transaction on the bus
+    volatile uint8_t head;
+    volatile uint8_t tail;
+    volatile uint8_t hhead;
+    volatile uint8_t htail;
+    volatile uint8_t active;
+    volatile uint8_t stuck;       // bus faulted, recover from the main loop
+    uint8_t hiaddr;               // priority lane device
+    uint8_t idx;
+    uint8_t pidx;
+    volatile uint16_t bytes;      // bus byte counter
+    uint16_t hi_stamp;            // byte count at priority enqueue
 };
 
-extern I2C I2c;
+extern I2C i2c;
 
 #endif
 
@@ -13,13 +13,135 @@
 
 extern I2C i2c;
 
+// SSD1306 initialization commands
+const uint8_t oled_init[] PROGMEM = {
+  0xD5, 0x80,   // set display clock divide ratio
+  0xA8, 0x3F,   // Set multiplex ratio to 1:64
+  0xD3, 0x00,   // set display offset = 0
+  0x40,         // set display start line address
+  0xA3, 0x20, 0x20, // set scroll area, rows 2-3 scroll
+  0x8D, 0x14,   // set charge pump, internal VCC
+  0x20, 0x00,   // set horizontal memory addressing
+  0xA4,         // output RAM to display
+  0xA1,         // set segment re-map
+  0xC8,         // set COM output scan direction
+  0xDA, 0x12,   // Set com pins hardware configuration
+  0x81, 0x80,   // set contrast control register
+  0xDB, 0x40,   // set vcomh
+  0xD9, 0xF1,   // 0xF1=brighter
+  0xB0,         // set page address (0-7)
+  0xA6,         // set display mode to normal
+  0xAF          // display ON
+};
+
+// text of the row being streamed, read by the glyph
+// generator from the TWI ISR until rowdone is set
+static uint8_t rowtext[OLED_COLS];
+static volatile uint8_t rowdone = I2C_OK;
+
+// the stepsize cursor is OR-ed into the upper page of
+// its row as the glyphs are sent, so redrawing a cell
+// never wipes it and drawing it never wipes the text
+#define GLYPH_CURSOR  0x80      // glyph arg flag, cursor page
+#define CURSOR_BITS   0x03      // top two lines of the page
+#define CURSOR_X0     2         // cursor columns in the cell
+#define CURSOR_W      4
+static uint8_t curcol;          // text column of the cursor
+
+// add the cursor to a glyph byte of the cursor page
+static inline uint8_t cursor(uint8_t b, uint8_t arg, uint8_t col, uint8_t x) {
+  if ((arg & GLYPH_CURSOR) && (col == curcol) && ((uint8_t)(x - CURSOR_X0) < CURSOR_W)) {
+    b |= CURSOR_BITS;
+  }
+  return(b);
+}
+
+#ifdef OLED_PRESTRETCH
+
+// compile-time index sequence 0..N-1, built by halving
+// so the template depth stays small
+template<uint16_t... I> struct fseq {};
+template<class A, class B> struct fcat;
+template<uint16_t... A, uint16_t... B> struct fcat<fseq<A...>, fseq<B...> > {
+  typedef fseq<A..., (sizeof...(A) + B)...> type;
+};
+template<uint16_t N> struct fmake {
+  typedef typename fcat<typename fmake<N/2>::type, typename fmake<N-N/2>::type>::type type;
+};
+template<> struct fmake<0> { typedef fseq<> type; };
+template<> struct fmake<1> { typedef fseq<0> type; };
+
+// stretch a nibble to a byte, each bit doubled
+constexpr uint8_t fstretch(uint8_t n) {
+  return(((n & 0x01) ? 0x03 : 0) | ((n & 0x02) ? 0x0C : 0) |
+         ((n & 0x04) ? 0x30 : 0) | ((n & 0x08) ? 0xC0 : 0));
+}
+
+// byte i of the stretched font: 16 bytes per glyph, the
+// upper page columns (low nibble) then the lower page
+constexpr uint8_t fbyte(uint16_t i) {
+  return(fstretch((font[((i >> 4) * FONT_W) + (i & 0x07)] >> ((i & 0x08) >> 1)) & 0x0F));
+}
+
+struct FontX2 {
+  uint8_t b[sizeof(font) * 2];
+};
+
+template<uint16_t... I> constexpr FontX2 fbuild(fseq<I...>) {
+  return(FontX2{{ fbyte(I)... }});
+}
+
+constexpr FontX2 fontx2 PROGMEM = fbuild(fmake<sizeof(font) * 2>::type());
+
+// glyph generator for the row data, arg is the first
+// text column shifted left by one plus the page half
+static uint8_t glyph(uint8_t arg, uint8_t idx) {
+  uint8_t col = ((arg & ~GLYPH_CURSOR) >> 1) + (idx / FONT_W);
+  uint8_t ch = rowtext[col];
+  uint8_t b = pgm_read_byte(&fontx2.b[((ch-32) << 4) | ((arg & 0x01) << 3) | (idx % FONT_W)]);
+  return(cursor(b, arg, col, idx % FONT_W));
+}
+
+#else
+
+// stretch one half of a font column vertically, half 0
+// is the low nibble (upper page), half 1 the high nibble
+static uint8_t stretch(uint8_t dat, uint8_t half) {
+  uint8_t mk1 = half ? 0x10 : 0x01;
+  uint8_t mk2 = 0x03;
+  uint8_t dax = 0;
+  for (uint8_t j=0; j<4; j++) {
+    if (dat & mk1) dax |= mk2;
+    mk1 = mk1 <<1;
+    mk2 = mk2 <<2;
+  }
+  return(dax);
+}
+
+// glyph generator for the row data, arg is the first
+// text column shifted left by one plus the page half
+static uint8_t glyph(uint8_t arg, uint8_t idx) {
+  uint8_t col = ((arg & ~GLYPH_CURSOR) >> 1) + (idx / FONT_W);
+  uint8_t ch = rowtext[col];
+  uint8_t b = stretch(pgm_read_byte(&(font[((ch-32)*FONT_W)+(idx % FONT_W)])), arg & 0x01);
+  return(cursor(b, arg, col, idx % FONT_W));
+}
+
+#endif
+
+// map a char to one the font can draw
+static uint8_t fontch(uint8_t ch) {
+  if (ch < 32 || ch > 137) ch = 32;
+  return(ch);
+}
+
 OLED::OLED() {
 }
 
 // Public Methods
 
 void OLED::begin() {
-  i2c.write(OLED_ADDR, OLED_COMMAND, oled_init, sizeof(oled_init));
+  i2c.write_P(OLED_ADDR, OLED_COMMAND, oled_init, sizeof(oled_init));
   wait(300);
   clrScreen();
 }
@@ -36,45 +158,60 @@ void OLED::wait(uint16_t x) {
 
 // send data
 void OLED::senddata(uint8_t data) {
-  i2c.write(OLED_ADDR, OLED_DATA, data);
+  i2c.post(OLED_ADDR, OLED_DATA, data);
 }
 
 // send zeros
 void OLED::sendzeros(uint8_t nbytes) {
-  i2c.writezeros(OLED_ADDR, OLED_DATA, nbytes);
+  i2c.postfill(OLED_ADDR, OLED_DATA, 0x00, nbytes);
 }
 
 // send ones
 void OLED::sendones(uint8_t nbytes) {
-  i2c.writeones(OLED_ADDR, OLED_DATA, nbytes);
+  i2c.postfill(OLED_ADDR, OLED_DATA, 0xff, nbytes);
 }
 
 // turn off the display
 void OLED::noDisplay() {
-  i2c.write(OLED_ADDR, OLED_COMMAND, OLED_OFF);
+  i2c.post(OLED_ADDR, OLED_COMMAND, OLED_OFF);
 }
 
 // turn on the display
 void OLED::onDisplay() {
-  i2c.write(OLED_ADDR, OLED_COMMAND, OLED_ON);
+  i2c.post(OLED_ADDR, OLED_COMMAND, OLED_ON);
+}
+
+// set the column and page window, data written in
+// horizontal mode wraps from x1 back to x0 on the next page
+void OLED::window(uint8_t x0, uint8_t x1, uint8_t p0, uint8_t p1) {
+  uint8_t data_arr[] = {
+  0x21, x0, x1,
+  0x22, p0, p1};
+  i2c.post(OLED_ADDR, OLED_COMMAND, data_arr, 6);
 }
 
 // set page
 void OLED::setPage(uint8_t x, uint8_t y) {
-  uint8_t data_arr[] = {
-  (OLED_PAGE | y),
-  (0x10 | ((x & 0xf0) >> 4)),
-  (x & 0x0f)};
-  i2c.write(OLED_ADDR, OLED_COMMAND, data_arr, 3);
+  window(x, OLED_MAXCOL-1, y, y);
+}
+
+// map a text row to the RAM row it is drawn in, rows
+// in the scroll area move with the scroll position
+uint8_t OLED::vrow(uint8_t row) {
+  row &= (OLED_ROWS-1);
+  if (row >= OLED_SCROLL) {
+    row = OLED_SCROLL + ((row - OLED_SCROLL + scrolled) & 0x01);
+  }
+  return(row);
 }
 
 // set cursor column and row
+// the window is set when the text is drawn
 void OLED::setCursor(uint8_t col, uint8_t row) {
   m_row = row;
   m_col = col;
   oledX = col*FONT_W;
-  oledY = ((row*FONT_H) & 0x06) | 0x01;
-  setPage(oledX, oledY);
+  oledY = (vrow(row)*FONT_H) | 0x01;
 }
 
 // set cursor to XY with no scaling
@@ -84,13 +221,40 @@ void OLED::setXY(uint8_t col, uint8_t row) {
   setPage(oledX, oledY);
 }
 
-// show the stepsize cursor
+// show the stepsize cursor, it shares the upper page of
+// text row 2, only the cells it leaves and enters are
+// redrawn from the shadow with the cursor added
 void OLED::showCursor() {
-  #define ROW 4
-  setPage(0, ROW);
-  sendzeros(OLED_MAXCOL);
-  setPage(oledX+2, ROW);
-  i2c.writecursor(OLED_ADDR, OLED_DATA);
+  uint8_t r = vrow(OLED_CURSOR/FONT_H);
+  uint8_t c = oledX / FONT_W;
+  uint8_t old = curcol;
+  if (cursorOK && (curcol == c)) return;
+  i2c.wait(&rowdone);
+  curcol = c;
+  if (cursorOK) cursorcell(r, old, NULL);
+  cursorOK = 1;
+  cursorcell(r, c, &rowdone);
+}
+
+// redraw the upper page of one cell of the cursor row
+// from the shadow, an unknown cell is drawn blank
+void OLED::cursorcell(uint8_t r, uint8_t c, volatile uint8_t *done) {
+  uint8_t p = r*FONT_H;
+  rowtext[c] = shadow[r][c] ? shadow[r][c] : ' ';
+  window(c*FONT_W, (c+1)*FONT_W - 1, p, p);
+  i2c.postgen(OLED_ADDR, OLED_DATA, glyph, (c << 1) | GLYPH_CURSOR, FONT_W, done);
+}
+
+// scroll rows 2-3 up one text row with a single start
+// line command, the old row 2 comes back as row 3, its
+// cursor cell is marked unknown so the next update of
+// row 3 draws it without the cursor, and the cursor is
+// drawn into the new row 2 on its next update
+void OLED::scroll() {
+  if (cursorOK) shadow[vrow(OLED_CURSOR/FONT_H)][curcol] = 0;
+  scrolled ^= 1;
+  i2c.post(OLED_ADDR, OLED_COMMAND, OLED_START | (scrolled * OLED_SCROLLH));
+  cursorOK = 0;
 }
 
 // set cursor to home
@@ -98,82 +262,88 @@ void OLED::home() {
   setCursor(0,0);
 }
 
-// clear to end of line
+// clear to end of line, only cells that are not
+// already blank are cleared
 void OLED::clr2eol() {
-  sendzeros(OLED_MAXCOL - oledX);
-  setXY(oledX, oledY+1);
-  sendzeros(OLED_MAXCOL - oledX);
+  i2c.wait(&rowdone);
+  for (uint8_t c=m_col; c<OLED_COLS; c++) rowtext[c] = ' ';
+  sync(OLED_COLS-1);
 }
 
 // clear a line
 void OLED::clrLine(uint8_t row) {
   setCursor(0, row);
-  sendzeros(OLED_MAXCOL);
-  setXY(0, oledY);
-  sendzeros(OLED_MAXCOL);
-  setCursor(0, row);
+  clr2eol();
 }
 
 // clear the screen
 void OLED::clrScreen() {
-  setCursor(0,0);
-  sendzeros(OLED_MAXCOL);
-  for (uint8_t p=1; p<8; p++) {
-    setPage(oledX, oledY+p);
+  window(0, OLED_MAXCOL-1, 0, 7);
+  for (uint8_t p=0; p<8; p++) {
     sendzeros(OLED_MAXCOL);
   }
+  for (uint8_t r=0; r<OLED_ROWS; r++) {
+    for (uint8_t c=0; c<OLED_COLS; c++) shadow[r][c] = ' ';
+  }
+  cursorOK = 0;
   setCursor(0,0);
 }
 
-// lookup the char in the font table and stretch it
-void OLED::lookup(uint8_t ch) {
-  uint8_t mk1;
-  uint8_t mk2;
-  uint8_t dat;
-  uint8_t dax;
-  for (uint8_t i=0; i<FONT_W; i++) {
-    // read the font data
-    dat = pgm_read_byte(&(font[((ch-32)*FONT_W)+i]));
-    mk1 = 0x01;
-    mk2 = 0x03;
-    dax = 0;
-    // stretch the data vertically
-    for (uint8_t j=0; j<4; j++) {
-      if (dat & mk1) dax |= mk2;
-      mk1 = mk1 <<1;
-      mk2 = mk2 <<2;
+// draw text columns c0 to c1 of the cursor row in one
+// window, both pages are streamed by the glyph generator
+void OLED::drawcells(uint8_t c0, uint8_t c1, volatile uint8_t *done) {
+  uint8_t p = oledY & 0x06;
+  uint8_t w = (c1 - c0 + 1) * FONT_W;
+  uint8_t g = (cursorOK && (p == vrow(OLED_CURSOR/FONT_H)*FONT_H)) ? GLYPH_CURSOR : 0;
+  window(c0*FONT_W, (c1+1)*FONT_W - 1, p, p+1);
+  i2c.postgen(OLED_ADDR, OLED_DATA, glyph, (c0 << 1) | g, w);
+  i2c.postgen(OLED_ADDR, OLED_DATA, glyph, (c0 << 1) | 1, w, done);
+}
+
+// push the row text from the cursor up to column last,
+// each run of cells that differ from the shadow is drawn
+// in its own window, the last one signals rowdone
+void OLED::sync(uint8_t last) {
+  uint8_t *s = shadow[oledY >> 1];
+  uint8_t c0 = 0xFF;
+  uint8_t c1 = 0;
+  uint8_t c = m_col;
+  while (c <= last) {
+    if (s[c] == rowtext[c]) {
+      c++;
+      continue;
     }
-    fx0[i]= dax;
-    mk1 = 0x10;
-    mk2 = 0x03;
-    dax = 0;
-    // stretch the data vertically
-    for (uint8_t j=0; j<4; j++) {
-      if (dat & mk1) dax |= mk2;
-      mk1 = mk1 <<1;
-      mk2 = mk2 <<2;
+    if (c0 != 0xFF) drawcells(c0, c1, NULL);
+    c0 = c;
+    while ((c <= last) && (s[c] != rowtext[c])) {
+      s[c] = rowtext[c];
+      c++;
     }
-    fx1[i]= dax;
+    c1 = c - 1;
   }
+  if (c0 != 0xFF) drawcells(c0, c1, &rowdone);
 }
 
 // print a char
 void OLED::putch(uint8_t ch) {
-  uint8_t i;
-  if ((ch == '\n') || (oledX > (128 - FONT_W))) return;
-  if (ch < 32 || ch > 137) ch = 32;
-  lookup(ch);
-  for (i=0; i<FONT_W; i++) senddata(fx1[i]);
-  setXY(oledX, oledY);
-  for (i=0; i<FONT_W; i++) senddata(fx0[i]);
+  if ((ch == '\n') || (m_col >= OLED_COLS)) return;
+  i2c.wait(&rowdone);
+  rowtext[m_col] = fontch(ch);
+  sync(m_col);
   m_col++;
   setCursor(m_col, m_row);
 }
 
-// print a string
+// print a string and clear to end of line
 void OLED::putstr(char *str) {
-  while(*str) putch(*str++);
-  clr2eol();
+  uint8_t c = m_col;
+  i2c.wait(&rowdone);
+  for (; *str && (c < OLED_COLS); str++) {
+    if (*str != '\n') rowtext[c++] = fontch(*str);
+  }
+  for (uint8_t i=c; i<OLED_COLS; i++) rowtext[i] = ' ';
+  if (m_col < OLED_COLS) sync(OLED_COLS-1);
+  setCursor(c, m_row);
 }
 
 // print a line
@@ -14,7 +14,18 @@
 #define OLED_PAGE     0xB0
 #define OLED_OFF      0xAE
 #define OLED_ON       0xAF
+#define OLED_START    0x40      // display start line
 #define OLED_MAXCOL   128
+#define OLED_ROWS     4         // text rows
+#define OLED_COLS     16        // text columns
+#define OLED_CURSOR   4         // page of the stepsize cursor
+#define OLED_SCROLL   2         // first text row of the scroll area
+#define OLED_SCROLLH  16        // display lines per text row
+
+// draw text from a font table stretched at compile time
+// (about 1.7K more flash), comment out to stretch the
+// glyphs on the CPU as they are sent
+#define OLED_PRESTRETCH
 
 class OLED {
 
@@ -30,15 +41,20 @@ public:
   void sendones(uint8_t);
   void noDisplay();
   void onDisplay();
+  void window(uint8_t, uint8_t, uint8_t, uint8_t);
   void setPage(uint8_t, uint8_t);
+  uint8_t vrow(uint8_t);
   void setCursor(uint8_t, uint8_t);
   void setXY(uint8_t, uint8_t);
   void showCursor();
+  void scroll();
   void home();
   void clr2eol();
   void clrLine(uint8_t);
   void clrScreen();
-  void lookup(uint8_t);
+  void drawcells(uint8_t, uint8_t, volatile uint8_t*);
+  void cursorcell(uint8_t, uint8_t, volatile uint8_t*);
+  void sync(uint8_t);
   void putch(uint8_t);
   void putstr(char *);
   void printline(uint8_t, char *);
@@ -55,28 +71,9 @@ public:
   uint8_t maddr = 1;
   uint8_t myrow = 0;
   uint8_t mycol = 0;
-  uint8_t fx1[10] = {0,0,0,0,0,0,0,0,0,0};
-  uint8_t fx0[10] = {0,0,0,0,0,0,0,0,0,0};
-
-  // SSD1306 initialization commands
-  const uint8_t oled_init [25] = {
-    0xD5, 0x80,   // set display clock divide ratio
-    0xA8, 0x3F,   // Set multiplex ratio to 1:64
-    0xD3, 0x00,   // set display offset = 0
-    0x40,         // set display start line address
-    0x8D, 0x14,   // set charge pump, internal VCC
-    0x20, 0x02,   // set page mode memory addressing
-    0xA4,         // output RAM to display
-    0xA1,         // set segment re-map
-    0xC8,         // set COM output scan direction
-    0xDA, 0x12,   // Set com pins hardware configuration
-    0x81, 0x80,   // set contrast control register
-    0xDB, 0x40,   // set vcomh
-    0xD9, 0xF1,   // 0xF1=brighter
-    0xB0,         // set page address (0-7)
-    0xA6,         // set display mode to normal
-    0xAF          // display ON
-  };
+  uint8_t shadow[OLED_ROWS][OLED_COLS];   // text on the display (0 = unknown)
+  uint8_t cursorOK = 0;
+  uint8_t scrolled = 0;
 
 };
 
@@ -0,0 +1,53 @@
+
+// ============================================================================
+//
+// pins.h   - compile-time GPIO pins
+//
+// ============================================================================
+
+#include <Arduino.h>
+#include <inttypes.h>
+
+#ifndef PINS_H
+#define PINS_H
+
+// ATmega328 I/O addresses of the input registers,
+// each port has DDRx at +1 and PORTx at +2
+#define PINB_ADDR  0x03
+#define PINC_ADDR  0x06
+#define PIND_ADDR  0x09
+
+// I/O address and bit of an Arduino pin number,
+// D0-D7 are PD0-PD7, D8-D13 PB0-PB5, A0-A5 PC0-PC5
+constexpr uint8_t pin_addr(uint8_t pin) {
+  return (pin < 8) ? PIND_ADDR : (pin < 14) ? PINB_ADDR : PINC_ADDR;
+}
+constexpr uint8_t pin_bit(uint8_t pin) {
+  return (pin < 8) ? pin : (pin < 14) ? (pin - 8) : (pin - 14);
+}
+
+// a pin known at compile time, every access is a
+// single sbi, cbi, sbis or sbic instruction in place
+// of the table lookups of digitalRead/digitalWrite
+template <uint8_t addr, uint8_t bit>
+struct GPIO {
+  static const uint8_t port = addr;
+  static const uint8_t mask = (1 << bit);
+  static inline uint8_t read() {
+    return (_SFR_IO8(addr) & mask) ? HIGH : LOW;
+  }
+  static inline void high() { _SFR_IO8(addr + 2) |= mask; }
+  static inline void low()  { _SFR_IO8(addr + 2) &= ~mask; }
+  static inline void write(uint8_t v) {
+    if (v) high();
+    else low();
+  }
+  static inline void output() { _SFR_IO8(addr + 1) |= mask; }
+  static inline void input()  { _SFR_IO8(addr + 1) &= ~mask; }
+};
+
+// the pin type for an Arduino pin number
+#define PIN(pin)  GPIO<pin_addr(pin), pin_bit(pin)>
+
+#endif
+
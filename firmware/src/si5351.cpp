@@ -32,10 +32,53 @@
 
 extern I2C i2c;
 
+// power-on PLL feedback for SI5351_PLL_FIXED off the crystal,
+// the values pll_calc() gives with no correction
+#define SI5351_REF     (SI5351_XTAL_FREQ * SI5351_FREQ_MULT)
+#define SI5351_FIX_A   (SI5351_PLL_FIXED / SI5351_REF)
+#define SI5351_FIX_B   (((SI5351_PLL_FIXED % SI5351_REF) * RFRAC_DENOM) / SI5351_REF)
+#define SI5351_FIX_C   (SI5351_FIX_B ? RFRAC_DENOM : 1)
+#define SI5351_FIX_P1  (128 * SI5351_FIX_A + ((128 * SI5351_FIX_B) / SI5351_FIX_C) - 512)
+#define SI5351_FIX_P2  (128 * SI5351_FIX_B - SI5351_FIX_C * ((128 * SI5351_FIX_B) / SI5351_FIX_C))
+#define SI5351_FIX_P3  SI5351_FIX_C
+
+// idle multisynth, integer 32 (25 MHz) until set_freq()
+#define SI5351_IDLE_P1 (128 * 32 - 512)
+
+// eight parameter bytes in register order
+#define SI5351_PARAMS(p1, p2, p3) \
+  (uint8_t)((p3) >> 8), (uint8_t)(p3), (uint8_t)(((p1) >> 16) & 0x03), \
+  (uint8_t)((p1) >> 8), (uint8_t)(p1), \
+  (uint8_t)((((p3) >> 12) & 0xF0) | (((p2) >> 16) & 0x0F)), \
+  (uint8_t)((p2) >> 8), (uint8_t)(p2)
+
+// power-on register image as blocks of register, length and
+// data, outputs are disabled first and the PLLs reset last
+const uint8_t si5351_image[] PROGMEM = {
+  SI5351_OUTPUT_ENABLE_CTRL, 1, 0xFF,
+  SI5351_OEB_PIN_ENABLE_CTRL, 1, 0xFF,
+  // CLK0-7 control, disable states, PLLA, PLLB, MS0-2
+  SI5351_CLK0_CTRL, 50,
+  SI5351_CLK0_INIT, SI5351_CLK1_INIT, SI5351_CLK2_INIT,
+  0x80, 0x80, 0x80, 0x80, 0x80,
+  0x00, 0x00,
+  SI5351_PARAMS(SI5351_FIX_P1, SI5351_FIX_P2, SI5351_FIX_P3),
+  SI5351_PARAMS(SI5351_FIX_P1, SI5351_FIX_P2, SI5351_FIX_P3),
+  SI5351_PARAMS(SI5351_IDLE_P1, 0, 1),
+  SI5351_PARAMS(SI5351_IDLE_P1, 0, 1),
+  SI5351_PARAMS(SI5351_IDLE_P1, 0, 1),
+  SI5351_VXCO_PARAMETERS_LOW, 3, 0x00, 0x00, 0x00,
+  // 8pF crystal load capacitance
+  SI5351_CRYSTAL_LOAD, 1, 0x92,
+  SI5351_PLL_RESET, 1, SI5351_PLL_RESET_A | SI5351_PLL_RESET_B,
+  0, 0
+};
+
 // Public functions
 
 void Si5351::init(void) {
   uint8_t i;
+  const uint8_t *p;
   // 25 MHz XO ref osc
   xtal_freq[SI5351_PLL_INPUT_XO] = SI5351_XTAL_FREQ;
   // use XO ref osc as default for each PLL
@@ -43,48 +86,153 @@ void Si5351::init(void) {
   pllb_ref_osc = SI5351_PLL_INPUT_XO;
   // no clock divider
   clkin_div = SI5351_CLKIN_DIV_1;
-  // set 8pF crystal load capacitance
-  write_reg(SI5351_CRYSTAL_LOAD, 0x92);
-  // the clock disable state is low
-  write_reg(SI5351_CLK3_0_DISABLE_STATE, 0x00);
-  write_reg(SI5351_OEB_PIN_ENABLE_CTRL,  0xFF);
-  // init clocks
-  for(i = 16; i < 19; i++) write_reg(i, 0x80);
-  for(i = 16; i < 19; i++) write_reg(i, 0x0C);
-  write_reg(SI5351_OUTPUT_ENABLE_CTRL, 0xFF);
-  // set PLLA and PLLB to 800 MHz for automatic tuning
-  set_pll(SI5351_PLL_FIXED, SI5351_PLLA);
-  set_pll(SI5351_PLL_FIXED, SI5351_PLLB);
-  // make PLL to CLK assignments for automatic tuning
-  for(i = 0; i < 3; i++) {
-    pll_assignment[i] = SI5351_PLLA;
-    set_ms_source(i, SI5351_PLLA);
-  }
-  // reset the VCXO param
-  write_reg(SI5351_VXCO_PARAMETERS_LOW, 0);
-  write_reg(SI5351_VXCO_PARAMETERS_MID, 0);
-  write_reg(SI5351_VXCO_PARAMETERS_HIGH, 0);
-  // then reset the PLLs
-  pll_reset(SI5351_PLLA);
-  pll_reset(SI5351_PLLB);
+  // every clock starts on a fractional multisynth
+  // with an empty parameter cache
+  for(i = 0; i < 3; i++) tune_div[i] = 0;
+  for(i = 0; i < SI5351_CACHE; i++) cache[i].pll = 0xFF;
+  for(i = 0; i < SI5351_PARKED; i++) parked[i].pll = 0xFF;
+  cache_hits = 0;
+  cache_misses = 0;
+  // write the power-on register image, one burst per
+  // block, which also fills the shadow
+  for (p = si5351_image; pgm_read_byte(p + 1); p += pgm_read_byte(p + 1) + 2) {
+    write_P(pgm_read_byte(p), pgm_read_byte(p + 1), p + 2);
+  }
+  // the image has both PLLs at 800 MHz with no
+  // correction and the clocks on their allocated PLL
+  plla_freq = SI5351_PLL_FIXED;
+  pllb_freq = SI5351_PLL_FIXED;
+  ref_correction[SI5351_PLL_INPUT_XO] = 0;
+  ref_correction[SI5351_PLL_INPUT_CLKIN] = 0;
+  pll_assignment[SI5351_CLK0] = SI5351_CLK0_PLL;
+  pll_assignment[SI5351_CLK1] = SI5351_CLK1_PLL;
+  pll_assignment[SI5351_CLK2] = SI5351_CLK2_PLL;
 }
 
 void Si5351::set_freq(uint64_t freq, uint8_t clk) {
+  uint8_t params[8];
+  ms_lookup(freq, pll_assignment[clk], params);
+  // set multisynth registers, in integer mode when
+  // the ratio allows it
+  write_ms(clk, params, ms_int(params));
+  tune_div[clk] = 0;
+}
+
+// compute a clock's multisynth set now and keep it
+// aside, swap() later writes it in one burst
+void Si5351::park(uint8_t slot, uint64_t freq, uint8_t clk) {
+  parked[slot].clk = clk;
+  parked[slot].pll = pll_assignment[clk];
+  ms_lookup(freq, parked[slot].pll, parked[slot].params);
+}
+
+// drop a parked set, swap() then refuses it
+void Si5351::unpark(uint8_t slot) {
+  parked[slot].pll = 0xFF;
+}
+
+// exchange a clock's registers with its parked set, so a
+// second swap goes back, fails (returns 0) if the set is
+// stale or the clock is PLL-tuned
+uint8_t Si5351::swap(uint8_t slot) {
+  struct Si5351Parked *p = &parked[slot];
+  uint8_t live[8];
+  uint8_t i;
+  if ((p->pll != pll_assignment[p->clk]) || tune_div[p->clk]) return 0;
+  for (i = 0; i < 8; i++) {
+    live[i] = get_reg(SI5351_CLK0_PARAMETERS + (p->clk * 8) + i);
+  }
+  live[2] &= 0x7F;
+  write_ms(p->clk, p->params, ms_int(p->params));
+  for (i = 0; i < 8; i++) p->params[i] = live[i];
+  return 1;
+}
+
+// packed multisynth set for a frequency on a PLL, from
+// the cache when it was used recently
+void Si5351::ms_lookup(uint64_t freq, uint8_t pll, uint8_t *params) {
   struct Si5351RegSet ms_reg;
-  uint64_t pll_freq;
-  uint8_t int_mode = 0;
   uint8_t div_by_4 = 0;
   uint8_t r_div = 0;
-  // select the proper R div value
-  r_div = select_r_div(&freq);
-  // calculate the synth parameters
-  if (pll_assignment[clk] == SI5351_PLLA) {
-    multisynth_calc(freq, plla_freq, &ms_reg);
+  uint8_t i;
+  // a recently used frequency skips the math
+  for (i = 0; i < SI5351_CACHE; i++) {
+    if ((cache[i].pll == pll) && (cache[i].freq == freq)) break;
+  }
+  if (i < SI5351_CACHE) {
+    cache_hits++;
   } else {
-    multisynth_calc(freq, pllb_freq, &ms_reg);
+    cache_misses++;
+    i = SI5351_CACHE - 1;
+    cache[i].freq = freq;
+    cache[i].pll = pll;
+    // select the proper R div value
+    r_div = select_r_div(&freq);
+    // calculate the synth parameters
+    if (pll == SI5351_PLLA) {
+      multisynth_calc(freq, plla_freq, &ms_reg);
+    } else {
+      multisynth_calc(freq, pllb_freq, &ms_reg);
+    }
+    ms_params(ms_reg, r_div, div_by_4, cache[i].params);
+  }
+  // move the entry to the front, the last one is evicted next
+  struct Si5351CacheEntry e = cache[i];
+  for (; i > 0; i--) cache[i] = cache[i - 1];
+  cache[0] = e;
+  for (i = 0; i < 8; i++) params[i] = e.params[i];
+}
+
+// tune by moving the PLL under a fixed even integer multisynth,
+// in-band steps only rewrite the PLL parameters (regs 26-33 for
+// PLLA) and a band change picks a new divider and resets the PLL,
+// other clocks on the same PLL move with it
+void Si5351::set_freq_pll(uint64_t freq, uint8_t clk) {
+  struct Si5351RegSet ms_reg;
+  uint8_t pll = pll_assignment[clk];
+  uint8_t r_div;
+  uint16_t div = tune_div[clk];
+  uint64_t vco;
+  // too high for an integer divider of 6 or more
+  if (freq > (SI5351_PLL_VCO_MAX * SI5351_FREQ_MULT) / SI5351_MULTISYNTH_A_MIN) {
+    set_freq(freq, clk);
+    return;
   }
-  // set multisynth registers
-  set_ms(clk, ms_reg, int_mode, r_div, div_by_4);
+  r_div = select_r_div(&freq);
+  vco = freq * div;
+  if ((vco >= SI5351_PLL_VCO_MIN * SI5351_FREQ_MULT) && (vco <= SI5351_PLL_VCO_MAX * SI5351_FREQ_MULT) &&
+      (((get_reg((SI5351_CLK0_PARAMETERS + 2) + (clk * 8)) >> SI5351_OUTPUT_CLK_DIV_SHIFT) & 0x07) == r_div)) {
+    set_pll(vco, pll);
+    return;
+  }
+  div = even_div(freq);
+  set_pll(freq * div, pll);
+  ms_reg.p1 = 128 * (uint32_t)div - 512;
+  ms_reg.p2 = 0;
+  ms_reg.p3 = 1;
+  set_ms(clk, ms_reg, 1, r_div, 0);
+  pll_reset(pll);
+  tune_div[clk] = div;
+}
+
+// the PLL, PLL frequency and multisynth that set_freq() or,
+// with pll_tuned, a band change in set_freq_pll() would pick
+// for a clock, nothing is written
+void Si5351::plan(uint64_t freq, uint8_t clk, uint8_t pll_tuned, struct Si5351Plan *p) {
+  struct Si5351RegSet ms_reg;
+  p->pll = pll_assignment[clk];
+  if (pll_tuned && (freq <= (SI5351_PLL_VCO_MAX * SI5351_FREQ_MULT) / SI5351_MULTISYNTH_A_MIN)) {
+    p->r_div = select_r_div(&freq);
+    p->ms_a = even_div(freq);
+    p->pll_freq = freq * p->ms_a;
+    p->integer = 1;
+    return;
+  }
+  p->pll_freq = (p->pll == SI5351_PLLA) ? plla_freq : pllb_freq;
+  p->r_div = select_r_div(&freq);
+  multisynth_calc(freq, p->pll_freq, &ms_reg);
+  p->ms_a = (ms_reg.p1 + 512) >> 7;
+  p->integer = !ms_reg.p2 && (ms_reg.p3 == 1) && !(ms_reg.p1 & 0xFF);
 }
 
 void Si5351::set_pll(uint64_t pll_freq, uint8_t target_pll) {
@@ -120,82 +268,45 @@ void Si5351::set_pll(uint64_t pll_freq, uint8_t target_pll) {
   params[i++] = temp;
   temp = (uint8_t)(pll_reg.p2  & 0xFF);
   params[i++] = temp;
+  // the cached multisynth values assume the old PLL
+  cache_drop(target_pll);
   // write the parameters
   if (target_pll == SI5351_PLLA) {
-    write_bulk(SI5351_PLLA_PARAMETERS, i, params);
+    write_delta(SI5351_PLLA_PARAMETERS, i, params);
     plla_freq = pll_freq;
   } else if (target_pll == SI5351_PLLB) {
-    write_bulk(SI5351_PLLB_PARAMETERS, i, params);
+    write_delta(SI5351_PLLB_PARAMETERS, i, params);
     pllb_freq = pll_freq;
   }
 }
 
 void Si5351::set_ms(uint8_t clk, struct Si5351RegSet ms_reg, uint8_t int_mode, uint8_t r_div, uint8_t div_by_4) {
-  uint8_t params[20];
-  uint8_t i = 0;
-  uint8_t temp;
-  uint8_t reg_val;
-  // registers 42-43 for CLK0
-  temp = (uint8_t)((ms_reg.p3 >> 8) & 0xFF);
-  params[i++] = temp;
-  temp = (uint8_t)(ms_reg.p3  & 0xFF);
-  params[i++] = temp;
-  // register 44 for CLK0
-  reg_val = read_reg((SI5351_CLK0_PARAMETERS + 2) + (clk * 8));
-  reg_val &= ~(0x03);
-  temp = reg_val | ((uint8_t)((ms_reg.p1 >> 16) & 0x03));
-  params[i++] = temp;
-  // registers 45-46 for CLK0
-  temp = (uint8_t)((ms_reg.p1 >> 8) & 0xFF);
-  params[i++] = temp;
-  temp = (uint8_t)(ms_reg.p1  & 0xFF);
-  params[i++] = temp;
-  // register 47 for CLK0
-  temp = (uint8_t)((ms_reg.p3 >> 12) & 0xF0);
-  temp += (uint8_t)((ms_reg.p2 >> 16) & 0x0F);
-  params[i++] = temp;
-  // registers 48-49 for CLK0
-  temp = (uint8_t)((ms_reg.p2 >> 8) & 0xFF);
-  params[i++] = temp;
-  temp = (uint8_t)(ms_reg.p2  & 0xFF);
-  params[i++] = temp;
-  // write the parameters
-  switch(clk) {
-    case SI5351_CLK0:
-      write_bulk(SI5351_CLK0_PARAMETERS, i, params);
-      set_int(clk, int_mode);
-      ms_div(clk, r_div, div_by_4);
-      break;
-    case SI5351_CLK1:
-      write_bulk(SI5351_CLK1_PARAMETERS, i, params);
-      set_int(clk, int_mode);
-      ms_div(clk, r_div, div_by_4);
-      break;
-    case SI5351_CLK2:
-      write_bulk(SI5351_CLK2_PARAMETERS, i, params);
-      set_int(clk, int_mode);
-      ms_div(clk, r_div, div_by_4);
-      break;
-    default:
-      break;
-  }
+  uint8_t params[8];
+  ms_params(ms_reg, r_div, div_by_4, params);
+  write_ms(clk, params, int_mode);
 }
 
+// a single queued write, key-down does not wait for the bus
 void Si5351::output_enable(uint8_t clk, uint8_t enable) {
   uint8_t reg_val;
-  reg_val = read_reg(SI5351_OUTPUT_ENABLE_CTRL);
+  reg_val = oe_reg;
   if (enable == 1) {
     reg_val &= ~(1<<clk);
   } else {
     reg_val |= (1<<clk);
   }
-  write_reg(SI5351_OUTPUT_ENABLE_CTRL, reg_val);
+  oe_reg = reg_val;
+  i2c.post(SI5351_I2C_ADDR, SI5351_OUTPUT_ENABLE_CTRL, reg_val);
+  // the read back waits for the bus, which an
+  // interrupt handler (the keyer tick) cannot do
+  if (!(SREG & _BV(SREG_I))) return;
+  if (verify && (read_reg(SI5351_OUTPUT_ENABLE_CTRL) != reg_val)) verify_err++;
 }
 
 void Si5351::drive_strength(uint8_t clk, uint8_t drive) {
   uint8_t reg_val;
   const uint8_t mask = 0x03;
-  reg_val = read_reg(SI5351_CLK0_CTRL + clk);
+  reg_val = get_reg(SI5351_CLK0_CTRL + clk);
   reg_val &= ~(mask);
   reg_val |= drive;
   write_reg(SI5351_CLK0_CTRL + clk, reg_val);
@@ -218,7 +329,7 @@ void Si5351::pll_reset(uint8_t target_pll) {
 
 void Si5351::set_ms_source(uint8_t clk, uint8_t pll) {
   uint8_t reg_val;
-  reg_val = read_reg(SI5351_CLK0_CTRL + clk);
+  reg_val = get_reg(SI5351_CLK0_CTRL + clk);
   if (pll == SI5351_PLLA) {
     reg_val &= ~(SI5351_CLK_PLL_SELECT);
   } else if (pll == SI5351_PLLB) {
@@ -230,7 +341,7 @@ void Si5351::set_ms_source(uint8_t clk, uint8_t pll) {
 
 void Si5351::set_int(uint8_t clk, uint8_t enable) {
   uint8_t reg_val;
-  reg_val = read_reg(SI5351_CLK0_CTRL + clk);
+  reg_val = get_reg(SI5351_CLK0_CTRL + clk);
   if (enable == 1) {
     reg_val |= (SI5351_CLK_INTEGER_MODE);
   } else {
@@ -242,7 +353,7 @@ void Si5351::set_int(uint8_t clk, uint8_t enable) {
 
 void Si5351::set_clock_pwr(uint8_t clk, uint8_t pwr) {
   uint8_t reg_val;
-  reg_val = read_reg(SI5351_CLK0_CTRL + clk);
+  reg_val = get_reg(SI5351_CLK0_CTRL + clk);
   if (pwr == 1)  {
     reg_val &= 0b01111111;
   } else {
@@ -253,10 +364,29 @@ void Si5351::set_clock_pwr(uint8_t clk, uint8_t pwr) {
 
 void Si5351::write_bulk(uint8_t addr, uint8_t bytes, uint8_t *data) {
   i2c.write(SI5351_I2C_ADDR, addr, data, bytes);
+  mirror(addr, bytes, data);
 }
 
 void Si5351::write_reg(uint8_t addr, uint8_t data) {
   i2c.write(SI5351_I2C_ADDR, addr, data);
+  mirror(addr, 1, &data);
+}
+
+// write a block from flash and copy it into the shadow
+void Si5351::write_P(uint8_t addr, uint8_t bytes, const uint8_t *data) {
+  uint8_t *reg;
+  uint8_t val;
+  i2c.write_P(SI5351_I2C_ADDR, addr, data, bytes);
+  for (uint8_t i = 0; i < bytes; i++) {
+    val = pgm_read_byte(data + i);
+    reg = shadow(addr + i);
+    if (reg) *reg = val;
+    if (verify && (read_reg(addr + i) != val)) verify_err++;
+  }
+}
+
+void Si5351::read_bulk(uint8_t addr, uint8_t bytes, uint8_t *data) {
+  i2c.read(SI5351_I2C_ADDR, addr, data, bytes);
 }
 
 uint8_t Si5351::read_reg(uint8_t addr) {
@@ -264,6 +394,14 @@ uint8_t Si5351::read_reg(uint8_t addr) {
   return reg_val;
 }
 
+// register value from the shadow, registers that
+// are not shadowed are read from the chip
+uint8_t Si5351::get_reg(uint8_t addr) {
+  uint8_t *reg = shadow(addr);
+  if (reg) return *reg;
+  return read_reg(addr);
+}
+
 // private functions
 
 uint64_t Si5351::pll_calc(uint8_t pll, uint64_t freq, struct Si5351RegSet *reg, int32_t corr, uint8_t vcxo) {
@@ -278,7 +416,18 @@ uint64_t Si5351::pll_calc(uint8_t pll, uint64_t freq, struct Si5351RegSet *reg,
   uint64_t lltmp;
   // factor calibration value into nominal crystal frequency
   // measured in parts-per-billion
-  ref_freq = ref_freq + (int32_t)((((((int64_t)corr) << 31) / 1000000000LL) * ref_freq) >> 31);
+#ifdef SI5351_FASTCALC
+  uint32_t rem;
+  uint8_t fast;
+  if ((corr >= -SI5351_CORR_MAX) && (corr <= SI5351_CORR_MAX)) {
+    int64_t k = div_32((uint64_t)(corr < 0 ? -corr : corr) << 31, 1000000000UL, &rem);
+    if (corr < 0) k = -k;
+    ref_freq = ref_freq + (int32_t)((k * ref_freq) >> 31);
+  } else
+#endif
+  {
+    ref_freq = ref_freq + (int32_t)((((((int64_t)corr) << 31) / 1000000000LL) * ref_freq) >> 31);
+  }
   // PLL bounds checking
   if (freq < SI5351_PLL_VCO_MIN * SI5351_FREQ_MULT) {
     freq = SI5351_PLL_VCO_MIN * SI5351_FREQ_MULT;
@@ -287,29 +436,47 @@ uint64_t Si5351::pll_calc(uint8_t pll, uint64_t freq, struct Si5351RegSet *reg,
     freq = SI5351_PLL_VCO_MAX * SI5351_FREQ_MULT;
   }
   // determine integer part of feedback equation
+#ifdef SI5351_FASTCALC
+  fast = !(ref_freq >> 32) && ((freq >> 32) < ref_freq);
+  if (fast) a = div_32(freq, ref_freq, &rem);
+  else a = freq / ref_freq;
+#else
   a = freq / ref_freq;
+#endif
   if (a < SI5351_PLL_A_MIN) {
     freq = ref_freq * SI5351_PLL_A_MIN;
   }
   if (a > SI5351_PLL_A_MAX) {
     freq = ref_freq * SI5351_PLL_A_MAX;
   }
-  // find best approximation for b/c = fVCO mod fIN
-  if (vcxo) {
-    b = (((uint64_t)(freq % ref_freq)) * 1000000ULL) / ref_freq;
-    c = 1000000ULL;
-  } else {
-    b = (((uint64_t)(freq % ref_freq)) * RFRAC_DENOM) / ref_freq;
-    c = b ? RFRAC_DENOM : 1;
+#ifdef SI5351_FASTCALC
+  if ((a < SI5351_PLL_A_MIN) || (a > SI5351_PLL_A_MAX)) fast = 0;
+  if (fast) {
+    // same b, c and frequency without 64-bit division
+    c = vcxo ? 1000000UL : RFRAC_DENOM;
+    b = muldiv(rem, c, ref_freq);
+    if (!vcxo && !b) c = 1;
+    lltmp = muldiv(b, ref_freq, c);
+  } else
+#endif
+  {
+    // find best approximation for b/c = fVCO mod fIN
+    if (vcxo) {
+      b = (((uint64_t)(freq % ref_freq)) * 1000000ULL) / ref_freq;
+      c = 1000000ULL;
+    } else {
+      b = (((uint64_t)(freq % ref_freq)) * RFRAC_DENOM) / ref_freq;
+      c = b ? RFRAC_DENOM : 1;
+    }
+    lltmp = ref_freq;
+    lltmp *= b;
+    do_div(lltmp, c);
   }
   // calculate parameters
   p1 = 128 * a + ((128 * b) / c) - 512;
   p2 = 128 * b - c * ((128 * b) / c);
   p3 = c;
   // recalculate frequency as fIN * (a + b/c)
-  lltmp = ref_freq;
-  lltmp *= b;
-  do_div(lltmp, c);
   freq = lltmp;
   freq += ref_freq * a;
   reg->p1 = p1;
@@ -359,6 +526,18 @@ uint64_t Si5351::multisynth_calc(uint64_t freq, uint64_t pll_freq, struct Si5351
   } else {
     // preset PLL, so return the actual freq for these params instead of PLL freq
     ret_val = 1;
+#ifdef SI5351_FASTCALC
+    // HF outputs from the 800 MHz PLL fit in 32 bits
+    uint32_t rem;
+    if (!(freq >> 32) && ((pll_freq >> 32) < freq)) {
+      a = div_32(pll_freq, freq, &rem);
+      if ((a >= SI5351_MULTISYNTH_A_MIN) && (a <= SI5351_MULTISYNTH_A_MAX)) {
+        b = muldiv(rem, RFRAC_DENOM, freq);
+        c = b ? RFRAC_DENOM : 1;
+        goto params;
+      }
+    }
+#endif
     // determine integer part of feedback equation
     a = pll_freq / freq;
     if (a < SI5351_MULTISYNTH_A_MIN)    {
@@ -370,6 +549,9 @@ uint64_t Si5351::multisynth_calc(uint64_t freq, uint64_t pll_freq, struct Si5351
     b = (pll_freq % freq * RFRAC_DENOM) / freq;
     c = b ? RFRAC_DENOM : 1;
   }
+#ifdef SI5351_FASTCALC
+params:
+#endif
   // calculate parameters
   if (divby4 == 1) {
     p3 = 1;
@@ -390,32 +572,159 @@ uint64_t Si5351::multisynth_calc(uint64_t freq, uint64_t pll_freq, struct Si5351
   }
 }
 
-void Si5351::ms_div(uint8_t clk, uint8_t r_div, uint8_t div_by_4) {
-  uint8_t reg_val = 0;
-  uint8_t reg_addr = 0;
-  switch(clk) {
-    case SI5351_CLK0:
-      reg_addr = SI5351_CLK0_PARAMETERS + 2;
-      break;
-    case SI5351_CLK1:
-      reg_addr = SI5351_CLK1_PARAMETERS + 2;
-      break;
-    case SI5351_CLK2:
-      reg_addr = SI5351_CLK2_PARAMETERS + 2;
-      break;
-    default:
-      break;
-  }
-  reg_val = read_reg(reg_addr);
-  reg_val &= ~(0x7C);
-  if (div_by_4 == 0) {
-    reg_val &= ~(SI5351_OUTPUT_CLK_DIVBY4);
-  } else {
-    reg_val |= (SI5351_OUTPUT_CLK_DIVBY4);
+// shadow location of a register (or NULL)
+uint8_t* Si5351::shadow(uint8_t addr) {
+  if (addr == SI5351_OUTPUT_ENABLE_CTRL) return &oe_reg;
+  if ((addr >= SI5351_CLK0_CTRL) && (addr < SI5351_CLK0_CTRL + SI5351_SHADOW_CTRL)) {
+    return &ctrl_reg[addr - SI5351_CLK0_CTRL];
+  }
+  if ((addr >= SI5351_SHADOW_BASE) && (addr < SI5351_SHADOW_BASE + SI5351_SHADOW_LEN)) {
+    return &synth_reg[addr - SI5351_SHADOW_BASE];
+  }
+  return NULL;
+}
+
+// copy written registers into the shadow, in verify
+// mode read them back and count any mismatch
+void Si5351::mirror(uint8_t addr, uint8_t bytes, uint8_t *data) {
+  uint8_t *reg;
+  for (uint8_t i = 0; i < bytes; i++) {
+    reg = shadow(addr + i);
+    if (reg) *reg = data[i];
+    if (verify && (read_reg(addr + i) != data[i])) verify_err++;
+  }
+}
+
+// pack multisynth parameters into register order
+// (regs 42-49 for CLK0), the top bit of the third
+// byte is left for write_ms to fill in
+void Si5351::ms_params(struct Si5351RegSet ms_reg, uint8_t r_div, uint8_t div_by_4, uint8_t *params) {
+  uint8_t i = 0;
+  uint8_t temp;
+  uint8_t reg_val;
+  // registers 42-43 for CLK0
+  temp = (uint8_t)((ms_reg.p3 >> 8) & 0xFF);
+  params[i++] = temp;
+  temp = (uint8_t)(ms_reg.p3  & 0xFF);
+  params[i++] = temp;
+  // register 44 for CLK0, R divider, DIVBY4 and P1[17:16]
+  reg_val = (r_div << SI5351_OUTPUT_CLK_DIV_SHIFT);
+  if (div_by_4) reg_val |= (SI5351_OUTPUT_CLK_DIVBY4);
+  temp = reg_val | ((uint8_t)((ms_reg.p1 >> 16) & 0x03));
+  params[i++] = temp;
+  // registers 45-46 for CLK0
+  temp = (uint8_t)((ms_reg.p1 >> 8) & 0xFF);
+  params[i++] = temp;
+  temp = (uint8_t)(ms_reg.p1  & 0xFF);
+  params[i++] = temp;
+  // register 47 for CLK0
+  temp = (uint8_t)((ms_reg.p3 >> 12) & 0xF0);
+  temp += (uint8_t)((ms_reg.p2 >> 16) & 0x0F);
+  params[i++] = temp;
+  // registers 48-49 for CLK0
+  temp = (uint8_t)((ms_reg.p2 >> 8) & 0xFF);
+  params[i++] = temp;
+  temp = (uint8_t)(ms_reg.p2  & 0xFF);
+  params[i++] = temp;
+}
+
+// write the changed parameters in one burst, then
+// the integer mode bit if it changed
+void Si5351::write_ms(uint8_t clk, uint8_t *params, uint8_t int_mode) {
+  uint8_t reg_val;
+  if (clk > SI5351_CLK2) return;
+  params[2] |= get_reg((SI5351_CLK0_PARAMETERS + 2) + (clk * 8)) & 0x80;
+  write_delta(SI5351_CLK0_PARAMETERS + (clk * 8), 8, params);
+  reg_val = get_reg(SI5351_CLK0_CTRL + clk);
+  if (((reg_val & SI5351_CLK_INTEGER_MODE) != 0) != (int_mode == 1)) set_int(clk, int_mode);
+}
+
+// an even integer ratio, P2 = 0, P3 = 1 and P1 a multiple
+// of 256, can run the multisynth in integer mode
+uint8_t Si5351::ms_int(uint8_t *params) {
+  return !params[0] && (params[1] == 1) && !(params[5] & 0x0F) &&
+         !params[6] && !params[7] && !params[4];
+}
+
+// largest even divider that keeps the VCO in range
+uint16_t Si5351::even_div(uint64_t freq) {
+  uint16_t div = ((SI5351_PLL_VCO_MAX * SI5351_FREQ_MULT) / freq) & ~1;
+  if (div > SI5351_MULTISYNTH_A_MAX) div = SI5351_MULTISYNTH_A_MAX;
+  return div;
+}
+
+// drop cached and parked multisynth parameters built on a PLL
+void Si5351::cache_drop(uint8_t pll) {
+  uint8_t i;
+  for (i = 0; i < SI5351_CACHE; i++) {
+    if (cache[i].pll == pll) cache[i].pll = 0xFF;
+  }
+  for (i = 0; i < SI5351_PARKED; i++) {
+    if (parked[i].pll == pll) parked[i].pll = 0xFF;
+  }
+}
+
+// write only the span of registers that differ from
+// the shadow, small tuning steps change one or two bytes
+void Si5351::write_delta(uint8_t addr, uint8_t bytes, uint8_t *data) {
+  uint8_t first = 0;
+  uint8_t last = bytes;
+  while ((first < bytes) && (get_reg(addr + first) == data[first])) first++;
+  if (first == bytes) return;
+  while (get_reg(addr + last - 1) == data[last - 1]) last--;
+  write_bulk(addr + first, last - first, data + first);
+}
+
+#ifdef SI5351_FASTCALC
+// n / d and n % d by shift-subtract with a 32-bit remainder,
+// the quotient must fit in 32 bits (n >> 32 less than d)
+uint32_t Si5351::div_32(uint64_t n, uint32_t d, uint32_t *rem) {
+  uint32_t r = n >> 32;
+  uint32_t lo = n;
+  uint32_t q = 0;
+  uint8_t carry;
+  for (uint8_t i = 0; i < 32; i++) {
+    carry = r >> 31;
+    r = (r << 1) | (lo >> 31);
+    lo <<= 1;
+    q <<= 1;
+    if (carry || (r >= d)) {
+      r -= d;
+      q |= 1;
+    }
+  }
+  *rem = r;
+  return q;
+}
+
+// x * m / d rounded down for x less than d, one step per
+// bit of m keeps the partial remainder below d in 32 bits
+uint32_t Si5351::muldiv(uint32_t x, uint32_t m, uint32_t d) {
+  uint32_t r = 0;
+  uint32_t q = 0;
+  uint32_t t;
+  uint32_t bit = 0x80000000UL;
+  while (bit && !(m & bit)) bit >>= 1;
+  for (; bit; bit >>= 1) {
+    t = r << 1;
+    q <<= 1;
+    if ((r >> 31) || (t >= d)) {
+      t -= d;
+      q++;
+    }
+    r = t;
+    if (m & bit) {
+      t = r + x;
+      if ((t < r) || (t >= d)) {
+        t -= d;
+        q++;
+      }
+      r = t;
+    }
   }
-  reg_val |= (r_div << SI5351_OUTPUT_CLK_DIV_SHIFT);
-  write_reg(reg_addr, reg_val);
+  return q;
 }
+#endif
 
 // select R divider
 uint8_t Si5351::select_r_div(uint64_t *freq) {
@@ -220,6 +220,40 @@
         __rem;                                                  \
  })
 
+/* Register shadow */
+
+// registers owned by the driver are kept in RAM and
+// updated without reading them back from the chip
+#define SI5351_SHADOW_CTRL    8     // CLK0-7 control, regs 16-23
+#define SI5351_SHADOW_BASE    SI5351_PLLA_PARAMETERS
+#define SI5351_SHADOW_LEN     40    // PLLA, PLLB, MS0-2, regs 26-65
+
+// PLL allocation, Tx and Rx share PLLA and the calibration
+// output has PLLB to itself, so tuning one never rewrites
+// the other
+#define SI5351_CLK0_PLL       SI5351_PLLA   // Tx
+#define SI5351_CLK1_PLL       SI5351_PLLA   // Rx
+#define SI5351_CLK2_PLL       SI5351_PLLB   // Cal
+#define SI5351_PLL_SEL(pll)   (((pll) == SI5351_PLLB) ? SI5351_CLK_PLL_SELECT : 0)
+
+// power-on clock control, powered up on their multisynth
+// and PLL, the outputs stay disabled until output_enable()
+#define SI5351_CLK0_INIT      (SI5351_CLK_INPUT_MULTISYNTH_N | SI5351_PLL_SEL(SI5351_CLK0_PLL) | SI5351_DRIVE_8MA)
+#define SI5351_CLK1_INIT      (SI5351_CLK_INPUT_MULTISYNTH_N | SI5351_PLL_SEL(SI5351_CLK1_PLL) | SI5351_DRIVE_2MA)
+#define SI5351_CLK2_INIT      (SI5351_CLK_INPUT_MULTISYNTH_N | SI5351_PLL_SEL(SI5351_CLK2_PLL) | SI5351_DRIVE_2MA)
+
+// divide with 32-bit shift-subtract loops when the divisor
+// fits in 32 bits (HF outputs, crystal reference), the
+// register values are the same as the 64-bit division
+#define SI5351_FASTCALC
+#define SI5351_CORR_MAX       1000000L  // ppb, larger corrections take the 64-bit path
+
+// recently used set_freq() results, most recent first
+#define SI5351_CACHE          4
+
+// multisynth sets parked for a one-burst swap()
+#define SI5351_PARKED         2
+
 /* Struct definitions */
 
 struct Si5351RegSet {
@@ -228,12 +262,38 @@ struct Si5351RegSet {
   uint32_t p3;
 };
 
+struct Si5351CacheEntry {
+  uint64_t freq;                // requested frequency
+  uint8_t  pll;                 // PLL it was built on (0xFF = empty)
+  uint8_t  params[8];           // multisynth registers, top bit of [2] clear
+};
+
+struct Si5351Parked {
+  uint8_t  clk;                 // clock the set is for
+  uint8_t  pll;                 // PLL it was built on (0xFF = empty)
+  uint8_t  params[8];           // multisynth registers, top bit of [2] clear
+};
+
+// what a clock would be set to, see plan()
+struct Si5351Plan {
+  uint8_t  pll;                 // PLLA or PLLB
+  uint8_t  r_div;               // output R divider
+  uint8_t  integer;             // even integer multisynth
+  uint16_t ms_a;                // integer part of the multisynth ratio
+  uint64_t pll_freq;            // PLL frequency
+};
+
 class Si5351 {
 
 public:
   // functions
   void init(void);
   void set_freq(uint64_t, uint8_t);
+  void set_freq_pll(uint64_t, uint8_t);
+  void park(uint8_t, uint64_t, uint8_t);
+  void unpark(uint8_t);
+  uint8_t swap(uint8_t);
+  void plan(uint64_t, uint8_t, uint8_t, struct Si5351Plan *);
   void set_pll(uint64_t, uint8_t);
   void set_ms(uint8_t, struct Si5351RegSet, uint8_t, uint8_t, uint8_t);
   void output_enable(uint8_t, uint8_t);
@@ -245,7 +305,9 @@ public:
   void set_clock_pwr(uint8_t, uint8_t);
   void write_bulk(uint8_t, uint8_t, uint8_t *);
   void write_reg(uint8_t, uint8_t);
+  void read_bulk(uint8_t, uint8_t, uint8_t *);
   uint8_t read_reg(uint8_t);
+  uint8_t get_reg(uint8_t);
   void powerDown(void);
   // variables
   uint8_t  pll_assignment[3];
@@ -254,16 +316,37 @@ public:
   uint8_t  plla_ref_osc;
   uint8_t  pllb_ref_osc;
   uint32_t xtal_freq[2];
+  uint8_t  verify = 0;          // read back every write
+  uint16_t verify_err = 0;      // read back mismatches
+  uint16_t cache_hits;          // set_freq() served from the cache
+  uint16_t cache_misses;        // set_freq() that did the math
 
 private:
   // functions
   uint64_t pll_calc(uint8_t, uint64_t, struct Si5351RegSet*, int32_t, uint8_t);
   uint64_t multisynth_calc(uint64_t, uint64_t, struct Si5351RegSet*);
-  void     ms_div(uint8_t, uint8_t, uint8_t);
   uint8_t  select_r_div(uint64_t *);
+  uint8_t* shadow(uint8_t);
+  void     mirror(uint8_t, uint8_t, uint8_t *);
+  void     write_delta(uint8_t, uint8_t, uint8_t *);
+  void     write_P(uint8_t, uint8_t, const uint8_t *);
+  void     ms_lookup(uint64_t, uint8_t, uint8_t *);
+  void     ms_params(struct Si5351RegSet, uint8_t, uint8_t, uint8_t *);
+  void     write_ms(uint8_t, uint8_t *, uint8_t);
+  uint8_t  ms_int(uint8_t *);
+  uint16_t even_div(uint64_t);
+  void     cache_drop(uint8_t);
+  uint32_t div_32(uint64_t, uint32_t, uint32_t *);
+  uint32_t muldiv(uint32_t, uint32_t, uint32_t);
   // variables
   int32_t ref_correction[2];
   uint8_t clkin_div;
+  uint8_t oe_reg;
+  uint8_t ctrl_reg[SI5351_SHADOW_CTRL];
+  uint8_t synth_reg[SI5351_SHADOW_LEN];
+  uint16_t tune_div[3];         // PLL-tuned integer divider (0 = off)
+  struct Si5351CacheEntry cache[SI5351_CACHE];
+  struct Si5351Parked parked[SI5351_PARKED];
 };
 
 #endif
@@ -0,0 +1,48 @@
+// ============================================================================
+//
+// calc_impl.cpp - one build of si5351.cpp for the si5351_calc test
+//
+// Built twice: with CALC=ref and CALC_SLOW, where SI5351_FASTCALC is
+// undefined and the calcs take the original 64-bit divisions, and with
+// CALC=fast. The class is renamed for each build so both link into one
+// program, and the private calcs are opened up to the test.
+//
+// ============================================================================
+
+#include <Arduino.h>
+#include "i2c.h"
+
+#define JOIN2(a, b)  a##b
+#define JOIN(a, b)   JOIN2(a, b)
+
+#define private public
+#define Si5351 JOIN(Si5351_, CALC)
+#include "si5351.h"
+#ifdef CALC_SLOW
+#undef SI5351_FASTCALC
+#endif
+#include "si5351.cpp"
+
+// multisynth_calc() for freq off pll, p1-p3 into r
+uint64_t JOIN(ms_, CALC)(uint64_t freq, uint64_t pll, uint32_t *r) {
+  static Si5351 si;
+  Si5351RegSet g;
+  uint64_t f = si.multisynth_calc(freq, pll, &g);
+  r[0] = g.p1;
+  r[1] = g.p2;
+  r[2] = g.p3;
+  return f;
+}
+
+// pll_calc() for PLLA at freq from a crystal with a ppb correction
+uint64_t JOIN(pll_, CALC)(uint64_t freq, int32_t corr, uint32_t xtal, uint8_t vcxo, uint32_t *r) {
+  static Si5351 si;
+  Si5351RegSet g;
+  si.xtal_freq[0] = xtal;
+  si.plla_ref_osc = 0;
+  uint64_t f = si.pll_calc(SI5351_PLLA, freq, &g, corr, vcxo);
+  r[0] = g.p1;
+  r[1] = g.p2;
+  r[2] = g.p3;
+  return f;
+}
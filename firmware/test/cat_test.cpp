@@ -0,0 +1,140 @@
+// ============================================================================
+//
+// cat_test.cpp - CAT command replies and the settings they change
+//
+// Boots the sketch on the host models, feeds CAT commands through the
+// UART model and compares what the firmware prints back.
+//
+// ============================================================================
+
+#include <stdio.h>
+#include <string.h>
+#include <Arduino.h>
+#include "host.h"
+#include "si5351.h"
+
+// from the sketch
+void init_pins();
+void init_timer0();
+void init_uart();
+void init_i2c();
+void init_VFO();
+void init_check();
+void init_oled();
+void init_wpm();
+void init_freq();
+void update_display();
+void check_CAT();
+void do_reset(uint8_t soft);
+extern int32_t txoffset;
+extern Si5351 si5351;
+
+#define TXOFS_ADDR  30
+#define SOFT        1
+
+static int fails = 0;
+
+// send host to the radio and check the reply
+static void cat(const char *host, const char *want) {
+  host_serout_clear();
+  host_serin(host);
+  while (host_serin_left()) check_CAT();
+  const char *got = host_serout();
+  if (strcmp(got, want)) {
+    printf("host %s radio %s, expected %s\n", host, got, want);
+    fails++;
+  }
+}
+
+// send host to the radio and look for want in the reply
+static void cat_has(const char *host, const char *want) {
+  host_serout_clear();
+  host_serin(host);
+  while (host_serin_left()) check_CAT();
+  if (!strstr(host_serout(), want)) {
+    printf("host %s radio %s, expected %s in it\n", host, host_serout(), want);
+    fails++;
+  }
+}
+
+static int clk_equal(int a, int b) {
+  return !memcmp(&si_reg[42 + 8 * a], &si_reg[42 + 8 * b], 8);
+}
+
+static int lookups() {
+  return si5351.cache_hits + si5351.cache_misses;
+}
+
+static void expect(const char *what, long got, long want) {
+  if (got != want) {
+    printf("%s: %ld, expected %ld\n", what, got, want);
+    fails++;
+  }
+}
+
+int main() {
+  init();
+  init_pins();
+  init_timer0();
+  init_uart();
+  init_i2c();
+  init_VFO();
+  init_check();
+  init_oled();
+  init_wpm();
+  init_freq();
+  update_display();
+
+  // RIT/XIT queries answer without eating the next command
+  cat("RT;FA;", "RT0;FA00014074000;");
+  cat("XT;RT0;RT;ID;", "XT0;RT0;ID019;");
+
+  // the other RIT state is parked when the offset changes,
+  // switching RIT is then a swap with no lookups
+  cat("RU01000;", "");
+  int n = lookups();
+  cat("RT1;RT0;RT1;", "");
+  expect("lookups switching RIT", lookups() - n, 0);
+  expect("CLK1 moved by RIT", clk_equal(1, 0), 0);
+
+  // a retune with RIT on only programs the two clocks
+  n = lookups();
+  cat("FA00014080000;", "");
+  expect("lookups for a retune", lookups() - n, 2);
+
+  // the first switch after the retune builds the sets
+  cat("RT0;", "");
+  expect("CLK1 back on CLK0 without RIT", clk_equal(1, 0), 1);
+  n = lookups();
+  cat("RT1;RT0;", "");
+  expect("lookups switching RIT again", lookups() - n, 0);
+  expect("CLK1 back on CLK0 after swaps", clk_equal(1, 0), 1);
+
+  // the offset reaches +-99999 Hz as on the TS-2000
+  cat_has("RC;RU99999;RU00010;IF;", "+99999");
+  cat_has("RC;RD99999;RD00010;IF;", "-99999");
+  cat("RC;", "");
+
+  // Tx offset, sign and 5 digits
+  cat("TO;", "TO+00000;");
+  expect("CLK0 and CLK1 registers equal", clk_equal(0, 1), 1);
+  cat("TO+00600;TO;", "TO+00600;");
+  expect("txoffset", txoffset, 600);
+  expect("CLK0 and CLK1 registers equal", clk_equal(0, 1), 0);
+  cat("TO-01500;ID;TO;", "ID019;TO-01500;");
+  cat("TO+99999;TO;", "TO+99999;");
+
+  // the offset is kept in the eeprom across a reset
+  cat("TO-00700;", "");
+  txoffset = 0;
+  do_reset(SOFT);
+  expect("txoffset after a reset", txoffset, -700);
+
+  // an erased cell gives the default offset
+  memset(&ee_mem[TXOFS_ADDR], 0xFF, 4);
+  do_reset(SOFT);
+  expect("txoffset from an erased eeprom", txoffset, 0);
+
+  printf("cat_test: %d failures\n", fails);
+  return fails != 0;
+}
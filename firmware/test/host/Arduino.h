@@ -0,0 +1,161 @@
+// ============================================================================
+//
+// Arduino.h - host build of the Arduino core and ATmega328 registers
+//
+// Just enough of the core for the firmware sources to build with g++.
+// Plain registers live in __io[], indexed by data space address. The
+// registers with side effects (TWI control, timer 0, SREG, EEPROM
+// control) are proxies implemented by the host models.
+//
+// ============================================================================
+
+#ifndef ARDUINO_H
+#define ARDUINO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <type_traits>
+
+#define F_CPU 16000000UL
+
+#define PROGMEM
+#define pgm_read_byte(p) (*(const uint8_t*)(p))
+#define pgm_read_word(p) (*(const uint16_t*)(p))
+#define ISR(v) extern "C" void v(void)
+
+// the empty asm() of the delay loops lets time pass on the host
+void host_spin();
+#define asm(x) host_spin()
+
+// data space, low I/O registers start at 0x20
+extern volatile uint8_t __io[256];
+#define _SFR_IO8(x)   (__io[(x) + 0x20])
+#define _SFR_MEM8(x)  (__io[(x)])
+#define _SFR_BYTE(s)  (s)
+#define _BV(b)        (1 << (b))
+
+// a register whose reads and writes go through the host models
+#define HOST_REG(name) \
+  struct name##Reg { name##Reg& operator=(uint8_t); operator uint8_t() const; \
+    name##Reg& operator|=(uint8_t v) { return *this = (uint8_t)(*this | v); } \
+    name##Reg& operator&=(uint8_t v) { return *this = (uint8_t)(*this & v); } }; \
+  extern name##Reg name##_reg;
+
+HOST_REG(TWCR)
+HOST_REG(SREG)
+HOST_REG(TCNT0)
+HOST_REG(TIFR0)
+HOST_REG(EECR)
+
+#define PINB    _SFR_IO8(0x03)
+#define DDRB    _SFR_IO8(0x04)
+#define PORTB   _SFR_IO8(0x05)
+#define PINC    _SFR_IO8(0x06)
+#define DDRC    _SFR_IO8(0x07)
+#define PORTC   _SFR_IO8(0x08)
+#define PIND    _SFR_IO8(0x09)
+#define DDRD    _SFR_IO8(0x0A)
+#define PORTD   _SFR_IO8(0x0B)
+#define TIFR0   TIFR0_reg
+#define PCIFR   _SFR_IO8(0x1B)
+#define EECR    EECR_reg
+#define EEDR    _SFR_IO8(0x20)
+#define EEAR    _SFR_IO8(0x21)
+#define TCCR0A  _SFR_IO8(0x24)
+#define TCCR0B  _SFR_IO8(0x25)
+#define TCNT0   TCNT0_reg
+#define OCR0A   _SFR_IO8(0x27)
+#define OCR0B   _SFR_IO8(0x28)
+#define SREG    SREG_reg
+#define PCICR   _SFR_MEM8(0x68)
+#define PCMSK2  _SFR_MEM8(0x6D)
+#define TIMSK0  _SFR_MEM8(0x6E)
+#define TIMSK1  _SFR_MEM8(0x6F)
+#define TIMSK2  _SFR_MEM8(0x70)
+#define ADCSRA  _SFR_MEM8(0x7A)
+#define TCCR1A  _SFR_MEM8(0x80)
+#define TCCR1B  _SFR_MEM8(0x81)
+#define ICR1L   _SFR_MEM8(0x86)
+#define ICR1H   _SFR_MEM8(0x87)
+#define OCR1AL  _SFR_MEM8(0x88)
+#define OCR1AH  _SFR_MEM8(0x89)
+#define OCR1BL  _SFR_MEM8(0x8A)
+#define OCR1BH  _SFR_MEM8(0x8B)
+#define TCCR2A  _SFR_MEM8(0xB0)
+#define TCCR2B  _SFR_MEM8(0xB1)
+#define TCNT2   _SFR_MEM8(0xB2)
+#define OCR2A   _SFR_MEM8(0xB3)
+#define OCR2B   _SFR_MEM8(0xB4)
+#define TWBR    _SFR_MEM8(0xB8)
+#define TWSR    _SFR_MEM8(0xB9)
+#define TWAR    _SFR_MEM8(0xBA)
+#define TWDR    _SFR_MEM8(0xBB)
+#define TWCR    TWCR_reg
+
+#define SREG_I   7
+#define TWINT    7
+#define TWEA     6
+#define TWSTA    5
+#define TWSTO    4
+#define TWWC     3
+#define TWEN     2
+#define TWIE     0
+#define TWPS0    0
+#define TWPS1    1
+#define OCIE0A   1
+#define OCIE0B   2
+#define OCF0A    1
+#define OCF0B    2
+#define PCINT18  2
+#define PCINT20  4
+#define PCINT22  6
+#define PCINT23  7
+#define PCIE2    2
+#define EEMPE    2
+#define EEPE     1
+#define EERE     0
+
+#define INPUT         0
+#define OUTPUT        1
+#define INPUT_PULLUP  2
+#define INTERNAL      3
+#define HIGH          1
+#define LOW           0
+#define DEC          10
+#define HEX          16
+
+void cli();
+void sei();
+#define interrupts()    sei()
+#define noInterrupts()  cli()
+
+void init();
+void pinMode(uint8_t, uint8_t);
+int  digitalRead(uint8_t);
+void digitalWrite(uint8_t, uint8_t);
+int  analogRead(uint8_t);
+void analogReference(uint8_t);
+void delayMicroseconds(unsigned int);
+
+// UART, input comes from host_serin(), output is kept for host_serout()
+struct HardwareSerial {
+  void begin(long) {}
+  int  available();
+  int  read();
+  void print(const char *s);
+  void print(char *s) { print((const char*)s); }
+  void print(char c);
+  void print(double v);
+  void print(float v) { print((double)v); }
+  template <class T> void print(T v, int base = DEC) {
+    if (std::is_signed<T>::value) printnum((long long)v, base);
+    else printunum((unsigned long long)v, base);
+  }
+  template <class T> void println(T v) { print(v); print("\r\n"); }
+  void printnum(long long v, int base);
+  void printunum(unsigned long long v, int base);
+};
+extern HardwareSerial Serial;
+
+#endif
@@ -0,0 +1,2 @@
+// si5351.cpp includes the I2C header with this spelling
+#include "i2c.h"
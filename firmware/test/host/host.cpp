@@ -0,0 +1,337 @@
+// ============================================================================
+//
+// host.cpp - TWI, SSD1306, Si5351, EEPROM, UART and pin models
+//
+// The TWI model answers every TWCR write that sets TWINT with the next
+// bus state and raises TWINT again at once, so a transaction runs to
+// the end inside the writes made by TWI_vect. TWI_vect is only called
+// while SREG has interrupts on and TWIE is set, as on the chip.
+//
+// ============================================================================
+
+#include <Arduino.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "host.h"
+
+volatile uint8_t __io[256];
+HardwareSerial Serial;
+TWCRReg TWCR_reg;
+SREGReg SREG_reg;
+EECRReg EECR_reg;
+
+HostBus host_bus;
+uint8_t oled_ram[8][128];
+uint8_t oled_startline = 0;
+uint8_t si_reg[256];
+uint8_t ee_mem[1024];
+int  host_stuck = 0;
+int  host_buserr = 0;
+long host_isr_us = 0;
+long host_cli_us = 0;
+uint64_t host_cyc = 0;
+
+static uint8_t sreg = 0x80;
+static uint8_t twcr = 0;
+static uint8_t pending = 0;    // TWINT raised, TWI_vect not run yet
+static uint8_t in_twi = 0;
+
+void host_bus_clear() { memset(&host_bus, 0, sizeof(host_bus)); }
+
+// ---------------------------------------------------------------------------
+// SSD1306, horizontal or page addressing
+
+static int o_page, o_col, o_mode = 2, o_c0 = 0, o_c1 = 127, o_p0 = 0, o_p1 = 7;
+static int o_ctrl, o_data, o_ncmd, o_need;
+static uint8_t o_cmd[4];
+
+static int oled_args(uint8_t c) {
+  switch (c) {
+    case 0x20: case 0x81: case 0x8D: case 0xA8: case 0xD3:
+    case 0xD5: case 0xD9: case 0xDA: case 0xDB: return 1;
+    case 0x21: case 0x22: case 0xA3: return 2;
+    default: return 0;
+  }
+}
+
+static void oled_exec() {
+  uint8_t c = o_cmd[0];
+  host_bus.oled_cmds++;
+  if ((c >= 0xB0) && (c <= 0xB7)) o_page = c & 7;
+  else if (c <= 0x0F) o_col = (o_col & 0xF0) | c;
+  else if (c <= 0x1F) o_col = (o_col & 0x0F) | ((c & 0x0F) << 4);
+  else if ((c >= 0x40) && (c <= 0x7F)) oled_startline = c & 0x3F;
+  else if (c == 0x20) o_mode = o_cmd[1];
+  else if (c == 0x21) { o_c0 = o_cmd[1]; o_c1 = o_cmd[2]; o_col = o_c0; }
+  else if (c == 0x22) { o_p0 = o_cmd[1]; o_p1 = o_cmd[2]; o_page = o_p0; }
+}
+
+static void oled_byte(uint8_t b) {
+  if (!o_ctrl) {
+    o_ctrl = 1;
+    o_data = (b & 0x40) != 0;
+    return;
+  }
+  if (o_data) {
+    host_bus.oled_data++;
+    oled_ram[o_page & 7][o_col & 127] = b;
+    if (o_mode == 2) {
+      if (o_col < 127) o_col++;
+    } else if (o_col >= o_c1) {
+      o_col = o_c0;
+      o_page = (o_page >= o_p1) ? o_p0 : o_page + 1;
+    } else o_col++;
+    return;
+  }
+  if (o_need == 0) {
+    o_cmd[0] = b;
+    o_ncmd = 1;
+    o_need = oled_args(b);
+    if (!o_need) oled_exec();
+    return;
+  }
+  o_cmd[o_ncmd++] = b;
+  if (--o_need == 0) oled_exec();
+}
+
+// ---------------------------------------------------------------------------
+// Si5351, auto-incrementing register pointer
+
+static int s_first, s_ptr;
+
+static void si_byte(uint8_t b) {
+  if (s_first) {
+    s_first = 0;
+    s_ptr = b;
+    return;
+  }
+  si_reg[s_ptr & 0xFF] = b;
+  host_bus.si_writes++;
+  s_ptr++;
+}
+
+// ---------------------------------------------------------------------------
+// TWI master
+
+#define NO_DEV   -1
+#define ADDR     -2            // START sent, address byte next
+
+static int dev = NO_DEV, reading = 0, owned = 0;
+
+static void twi_step(uint8_t v) {
+  if (host_stuck) return;      // a slave holds the bus, TWINT never rises
+  if (host_buserr && !(v & (_BV(TWSTA) | _BV(TWSTO))) && (dev != NO_DEV)
+      && (--host_buserr == 0)) {
+    TWSR = 0x00;               // bus error
+    owned = 0;
+    dev = NO_DEV;
+  } else if (v & _BV(TWSTA)) {
+    if (v & _BV(TWSTO)) owned = 0;
+    TWSR = owned ? 0x10 : 0x08;
+    owned = 1;
+    dev = ADDR;
+    host_bus.starts++;
+  } else if (v & _BV(TWSTO)) {
+    owned = 0;
+    dev = NO_DEV;
+    twcr &= ~_BV(TWSTO);
+    return;                    // STOP does not raise TWINT
+  } else if (dev == ADDR) {
+    uint8_t a = TWDR >> 1;
+    reading = TWDR & 1;
+    host_bus.bytes++;
+    if (a == 0x3C) {
+      dev = a;
+      o_ctrl = 0;
+      o_need = 0;
+      host_bus.oled_txn++;
+      TWSR = 0x18;
+    } else if (a == 0x60) {
+      dev = a;
+      if (!reading) s_first = 1;
+      host_bus.si_txn++;
+      TWSR = reading ? 0x40 : 0x18;
+    } else {
+      dev = NO_DEV;
+      host_bus.nacks++;
+      TWSR = reading ? 0x48 : 0x20;
+    }
+  } else if (reading) {
+    host_bus.bytes++;
+    host_bus.si_reads++;
+    TWDR = si_reg[s_ptr & 0xFF];
+    s_ptr++;
+    TWSR = (v & _BV(TWEA)) ? 0x50 : 0x58;
+  } else {
+    host_bus.bytes++;
+    if (dev == 0x3C) oled_byte(TWDR);
+    else if (dev == 0x60) si_byte(TWDR);
+    TWSR = 0x28;
+  }
+  twcr = (v & ~(_BV(TWSTA) | _BV(TWSTO))) | _BV(TWINT);
+  pending = 1;
+}
+
+extern "C" void TWI_vect(void);
+
+// run TWI_vect for as long as it has work and may run
+static void twi_service() {
+  while (pending && !in_twi && (sreg & 0x80) && (twcr & _BV(TWIE))) {
+    pending = 0;
+    in_twi = 1;
+    sreg &= ~0x80;
+    TWI_vect();
+    sreg |= 0x80;
+    in_twi = 0;
+  }
+}
+
+TWCRReg& TWCRReg::operator=(uint8_t v) {
+  if (!(v & _BV(TWEN))) {
+    twcr = v;
+    pending = 0;
+    owned = 0;
+    return *this;
+  }
+  if (v & _BV(TWINT)) {
+    twcr = v & ~_BV(TWINT);
+    pending = 0;
+    twi_step(v);
+  } else twcr = (twcr & _BV(TWINT)) | v;
+  twi_service();
+  return *this;
+}
+TWCRReg::operator uint8_t() const { return twcr; }
+
+SREGReg& SREGReg::operator=(uint8_t v) {
+  sreg = v;
+  twi_service();
+  return *this;
+}
+SREGReg::operator uint8_t() const { return sreg; }
+
+void cli() { sreg &= ~0x80; }
+void sei() {
+  sreg |= 0x80;
+  twi_service();
+}
+
+// ---------------------------------------------------------------------------
+// EEPROM, writes and reads complete at once
+
+static uint8_t eecr = 0;
+
+EECRReg& EECRReg::operator=(uint8_t v) {
+  uint16_t a = EEAR % sizeof(ee_mem);
+  if (v & _BV(EEPE)) ee_mem[a] = EEDR;
+  if (v & _BV(EERE)) EEDR = ee_mem[a];
+  eecr = v & ~(_BV(EEPE) | _BV(EERE) | _BV(EEMPE));
+  return *this;
+}
+EECRReg::operator uint8_t() const { return eecr; }
+
+// ---------------------------------------------------------------------------
+// UART
+
+static const char *serin = "";
+static char serout[4096];
+static int nout = 0;
+
+void host_serin(const char *s) { serin = s; }
+int host_serin_left() { return strlen(serin); }
+const char *host_serout() { return serout; }
+void host_serout_clear() { nout = 0; serout[0] = 0; }
+
+static long starve = 0;
+int HardwareSerial::available() {
+  if (*serin) {
+    starve = 0;
+    return 1;
+  }
+  if (++starve > 100000000L) {
+    printf("firmware still waiting for UART input after \"%s\"\n", serout);
+    exit(1);
+  }
+  return 0;
+}
+int HardwareSerial::read() { return *serin ? *serin++ : -1; }
+
+void HardwareSerial::print(const char *s) {
+  while (*s && (nout < (int)sizeof(serout) - 1)) serout[nout++] = *s++;
+  serout[nout] = 0;
+}
+void HardwareSerial::print(char c) {
+  char s[2] = {c, 0};
+  print((const char*)s);
+}
+void HardwareSerial::print(double v) {
+  char s[32];
+  snprintf(s, sizeof(s), "%.2f", v);
+  print((const char*)s);
+}
+void HardwareSerial::printnum(long long v, int base) {
+  if (v < 0) {
+    print('-');
+    printunum(-(unsigned long long)v, base);
+  } else printunum(v, base);
+}
+void HardwareSerial::printunum(unsigned long long v, int base) {
+  char s[32];
+  snprintf(s, sizeof(s), (base == HEX) ? "%llX" : "%llu", v);
+  print((const char*)s);
+}
+
+// ---------------------------------------------------------------------------
+// pins and core functions, each core call costs the time it takes on
+// the chip so handlers that use them take time on the timer 0 model
+
+#define PORTB_KEY  0x01        // KEYOUT is PB0
+
+HostEdge host_edges[4096];
+int host_nedges = 0;
+static int key_level = 0;
+
+void host_edges_clear() { host_nedges = 0; }
+int host_keyout() { return PORTB & PORTB_KEY; }
+
+void host_key_edge() {
+  int v = host_keyout();
+  if (v == key_level) return;
+  key_level = v;
+  if (host_nedges < (int)(sizeof(host_edges) / sizeof(host_edges[0]))) {
+    host_edges[host_nedges].cyc = host_cyc;
+    host_edges[host_nedges].level = v;
+    host_nedges++;
+  }
+}
+
+void init() {
+  PIND = 0xFF;                 // pull-ups, nothing pressed
+  PINB = 0xFF;
+  PINC = 0xFF;
+}
+void pinMode(uint8_t, uint8_t) {}
+
+int digitalRead(uint8_t pin) {
+  host_cyc += 40;
+  if (pin < 8) return (PIND >> pin) & 1;
+  if (pin < 14) return (PINB >> (pin - 8)) & 1;
+  return 1;
+}
+
+void digitalWrite(uint8_t pin, uint8_t v) {
+  host_cyc += 40;
+  if ((pin >= 8) && (pin < 14)) {
+    if (v) PORTB |= 1 << (pin - 8);
+    else PORTB &= ~(1 << (pin - 8));
+    host_key_edge();
+  }
+}
+
+int analogRead(uint8_t) { return 0; }
+void analogReference(uint8_t) {}
+
+void delayMicroseconds(unsigned int us) {
+  if (in_twi) host_isr_us += us;
+  if (!(sreg & 0x80)) host_cli_us += us;
+}
@@ -0,0 +1,67 @@
+// ============================================================================
+//
+// host.h - host models behind the Arduino core stub
+//
+// host.cpp models the TWI master with an SSD1306 and an Si5351 on the
+// bus, the EEPROM, the UART and the pins. timer0.cpp models timer 0
+// and runs the firmware interrupt handlers as its compare points pass.
+//
+// ============================================================================
+
+#ifndef HOST_H
+#define HOST_H
+
+#include <stdint.h>
+
+// bus traffic counters
+struct HostBus {
+  long starts;         // START and repeated START conditions
+  long bytes;          // address and data bytes on the wire
+  long nacks;          // addresses nobody answered
+  long oled_txn;       // transactions per device
+  long si_txn;
+  long oled_data;      // SSD1306 display data bytes
+  long oled_cmds;      // SSD1306 commands
+  long si_writes;      // Si5351 register writes and reads
+  long si_reads;
+};
+extern HostBus host_bus;
+void host_bus_clear();
+
+extern uint8_t oled_ram[8][128];       // SSD1306 display RAM
+extern uint8_t oled_startline;         // display start line (0x40)
+extern uint8_t si_reg[256];            // Si5351 registers
+extern uint8_t ee_mem[1024];           // EEPROM
+
+// fault injection
+extern int  host_stuck;        // bus never raises TWINT while set
+extern int  host_buserr;       // bus error on the nth data byte from now
+extern long host_isr_us;       // us of delay spent inside TWI_vect
+extern long host_cli_us;       // us of delay spent with interrupts off
+
+// cpu time in 16 MHz cycles, moved on by the models and timer 0
+extern uint64_t host_cyc;
+
+// UART
+void host_serin(const char *s);        // bytes the host sends next
+const char *host_serout();             // everything the firmware printed
+void host_serout_clear();
+int  host_serin_left();
+
+// pins: the paddles on D6/D7, the key line on D8 (PB0)
+void host_pads(int dit, int dah);      // also raises PCINT2_vect
+int  host_keyout();
+
+// timer 0 in CTC mode at 250 counts per ms
+void host_run(uint64_t cycles);        // run time forward, taking interrupts
+extern int host_isr_load;              // extra cycles per interrupt entry
+extern long host_ticks_b[250];         // compare B interrupts by count
+
+// KEYOUT edges: cycle time and new level
+struct HostEdge { uint64_t cyc; int level; };
+extern HostEdge host_edges[];
+extern int host_nedges;
+void host_edges_clear();
+void host_key_edge();                  // record a KEYOUT change
+
+#endif
@@ -0,0 +1,107 @@
+// ============================================================================
+//
+// timer0.cpp - timer 0 model and interrupt dispatch
+//
+// Timer 0 counts in 4 us steps (64 cycles) and clears at 250 counts, as
+// init_timer0() sets it up. host_run() moves time forward and runs the
+// compare A and compare B handlers as their compare points pass, with
+// an entry latency, and records every KEYOUT edge.
+//
+// ============================================================================
+
+#include <Arduino.h>
+#include "host.h"
+
+#define T0CYC    64            // cycles per count
+#define T0TOP    250           // counts per ms
+#define ISR_CYC  40            // interrupt entry latency (cycles)
+
+extern "C" void TIMER0_COMPA_vect(void) __attribute__((weak));
+extern "C" void TIMER0_COMPB_vect(void) __attribute__((weak));
+extern "C" void PCINT2_vect(void) __attribute__((weak));
+
+TCNT0Reg TCNT0_reg;
+TIFR0Reg TIFR0_reg;
+int host_isr_load = 0;
+long host_ticks_b[T0TOP];
+
+static uint64_t counts = 0;    // timer counts done
+static int fa = 0, fb = 0;     // compare flags
+static uint8_t bcount;         // count compare B matched at
+
+// move the timer up to the cpu time
+static void catch_up() {
+  uint64_t now = host_cyc / T0CYC;
+  while (counts < now) {
+    counts++;
+    uint8_t c = counts % T0TOP;
+    if (c == 0) fa = 1;
+    if (c == OCR0B) {
+      fb = 1;
+      bcount = c;
+    }
+  }
+}
+
+TCNT0Reg::operator uint8_t() const {
+  host_cyc += 8;
+  catch_up();
+  return (host_cyc / T0CYC) % T0TOP;
+}
+TCNT0Reg& TCNT0Reg::operator=(uint8_t) { return *this; }
+
+TIFR0Reg::operator uint8_t() const {
+  catch_up();
+  return (fa ? _BV(OCF0A) : 0) | (fb ? _BV(OCF0B) : 0);
+}
+TIFR0Reg& TIFR0Reg::operator=(uint8_t v) {
+  if (v & _BV(OCF0A)) fa = 0;
+  if (v & _BV(OCF0B)) fb = 0;
+  return *this;
+}
+
+static void isr(void (*vect)(void)) {
+  host_cyc += ISR_CYC + host_isr_load;
+  cli();
+  if (vect) vect();
+  sei();
+  host_key_edge();
+  catch_up();
+}
+
+// take the pending compare interrupts, compare A first
+static void dispatch() {
+  catch_up();
+  while ((fa && (TIMSK0 & _BV(OCIE0A))) || (fb && (TIMSK0 & _BV(OCIE0B)))) {
+    if (fa && (TIMSK0 & _BV(OCIE0A))) {
+      fa = 0;
+      isr(TIMER0_COMPA_vect);
+    } else {
+      fb = 0;
+      host_ticks_b[bcount]++;
+      isr(TIMER0_COMPB_vect);
+    }
+  }
+}
+
+void host_run(uint64_t cycles) {
+  uint64_t end = host_cyc + cycles;
+  while (host_cyc < end) {
+    host_cyc += T0CYC;
+    dispatch();
+  }
+}
+
+// one pass of a delay loop in the main line
+void host_spin() {
+  host_cyc += 4;
+  if (SREG & _BV(SREG_I)) dispatch();
+}
+
+// paddles are active low on PD6 (dit) and PD7 (dah)
+void host_pads(int dit, int dah) {
+  uint8_t v = 0xFF & ~((dit ? 0x40 : 0) | (dah ? 0x80 : 0));
+  if (PIND == v) return;
+  PIND = v;
+  if (PCMSK2 & 0xC0) isr(PCINT2_vect);
+}
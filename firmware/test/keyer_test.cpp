@@ -0,0 +1,350 @@
+// ============================================================================
+//
+// keyer_test.cpp - keyer element timing on the timer 0 model
+//
+// The keyer runs from the sketch's timer 0 handlers while host_run()
+// moves time on, and the KEYOUT edges are timed in cpu cycles. PARIS
+// is taken as 10 dits, 4 dahs, 9 element spaces, 4 letter spaces and
+// a word space, from dits and dahs measured with a paddle held, and
+// compared with 50 dits of 1200/WPM ms. Bouncy paddle contacts and
+// single glitches are then fed through the pin change interrupt, and
+// KY text is sent from the buffer and cut short by a paddle.
+//
+// ============================================================================
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <Arduino.h>
+#include "host.h"
+
+// from the sketch
+void init_pins();
+void init_timer0();
+void init_uart();
+void init_i2c();
+void init_VFO();
+void init_check();
+void init_oled();
+void init_wpm();
+void init_freq();
+void init_keyer();
+void init_encoder();
+void update_display();
+void ky_put(char ch);
+void straight_key();
+extern uint8_t keyerwpm, keyermode, keyerinfo;
+extern volatile uint8_t keyerstate, kyhead, kytail;
+extern char kybuf[];
+extern uint32_t lettergap2, wordgap2;
+
+#define MS         16000.0     // cycles per ms
+#define T0KEYOCR   124         // regular compare B count
+#define ULTIMATIC  3
+#define STRAIGHT   0
+#define KEY_IDLE   0
+
+static int fails = 0;
+
+static void expect(const char *what, double got, double lo, double hi) {
+  if ((got < lo) || (got > hi)) {
+    printf("%s: %g, expected %g to %g\n", what, got, lo, hi);
+    fails++;
+  }
+}
+
+static void set_wpm(uint8_t wpm) {
+  keyerwpm = wpm;
+  init_wpm();
+  init_keyer();
+}
+
+// hold a paddle for secs, then release it for half a second,
+// mean key-down and key-up times in ms and the spread of the
+// key-down times in us
+struct Hold { double on, off, spread; };
+static Hold hold(int dit, double secs) {
+  Hold h = {0, 0, 0};
+  double non = 0, noff = 0, onmin = 1e9, onmax = 0;
+  host_edges_clear();
+  host_pads(dit, !dit);
+  host_run(secs * 1000 * MS);
+  host_pads(0, 0);
+  host_run(500 * MS);
+  for (int i = 1; i < host_nedges; i++) {
+    double d = (host_edges[i].cyc - host_edges[i - 1].cyc) / MS;
+    if (host_edges[i - 1].level) {
+      h.on += d;
+      non++;
+      if (d < onmin) onmin = d;
+      if (d > onmax) onmax = d;
+    } else {
+      h.off += d;
+      noff++;
+    }
+  }
+  h.on /= non;
+  h.off /= noff;
+  h.spread = (onmax - onmin) * 1000;
+  return h;
+}
+
+// element and PARIS errors in percent at one speed, returns
+// the largest element error
+static double paris(uint8_t wpm, double *perr, int print) {
+  set_wpm(wpm);
+  Hold d = hold(1, 3.0);
+  Hold a = hold(0, 3.0);
+  double u = 1200.0 / wpm;
+  double word = 10 * d.on + 4 * a.on + 9 * d.off +
+                4 * lettergap2 * 0.004 + wordgap2 * 0.004;
+  double ed = 100 * (d.on - u) / u;
+  double ea = 100 * (a.on - 3 * u) / (3 * u);
+  double es = 100 * (d.off - u) / u;
+  *perr = 100 * (word - 50 * u) / (50 * u);
+  if (print) {
+    printf("%3d  %8.3f %7.3f %7.3f %7.3f  %9.2f %8.1f %7.3f  %5.0f\n", wpm,
+      d.on, ed, ea, es, word, 50 * u, *perr, fmax(d.spread, a.spread));
+  }
+  return fmax(fabs(ed), fmax(fabs(ea), fabs(es)));
+}
+
+// cycles from now to a point us into the next ms
+static uint64_t next_ms(double us) {
+  return 16000 - host_cyc % 16000 + (uint64_t)(us * 16);
+}
+
+// us of contact bounce, from lo to hi
+static uint64_t bounce(int lo, int hi) {
+  return (lo + rand() % (hi - lo)) * 16;
+}
+
+// key-down times in ms of the elements since the edges were cleared
+static int elements(double *len, int max) {
+  int n = 0;
+  for (int i = 1; i < host_nedges; i++) {
+    if (host_edges[i - 1].level && (n < max)) {
+      len[n++] = (host_edges[i].cyc - host_edges[i - 1].cyc) / MS;
+    }
+  }
+  return n;
+}
+
+// cycle times of the key-down edges since the edges were cleared
+static int downs(uint64_t *cyc, int max) {
+  int n = 0;
+  for (int i = 0; i < host_nedges; i++) {
+    if (host_edges[i].level && (n < max)) cyc[n++] = host_edges[i].cyc;
+  }
+  return n;
+}
+
+// compare B ticks that did not fire at the regular count
+static long moved() {
+  long n = 0;
+  for (int c = 0; c < 250; c++) {
+    if (c != T0KEYOCR) n += host_ticks_b[c];
+  }
+  return n;
+}
+
+int main() {
+  init();
+  init_pins();
+  init_timer0();
+  init_uart();
+  init_i2c();
+  init_VFO();
+  init_check();
+  init_oled();
+  init_wpm();
+  init_freq();
+  init_keyer();
+  update_display();
+  keyermode = ULTIMATIC;
+
+  // element timing to a few cycles of timer 0 at every speed
+  uint8_t wpms[] = {10, 13, 20, 25, 33, 40, 47, 55, 60, 70, 80, 90};
+  double perr;
+  printf("wpm  dit (ms)  dit %%   dah %%   ies %%  PARIS(ms)    ideal    err %%  spread(us)\n");
+  for (unsigned i = 0; i < sizeof(wpms); i++) {
+    double err = paris(wpms[i], &perr, 1);
+    expect("element error (%)", err, 0, 0.1);
+    expect("PARIS error (%)", perr, -0.05, 0.05);
+  }
+
+  // 100 us more interrupt entry latency at 60 WPM
+  host_isr_load = 1600;
+  double err = paris(60, &perr, 0);
+  printf("60 WPM with 100 us more latency: elements %.3f%%, PARIS %+.3f%%\n", err, perr);
+  expect("element error with latency (%)", err, 0, 0.75);
+  expect("PARIS error with latency (%)", perr, -0.25, 0.25);
+  host_isr_load = 0;
+
+  // after a deadline the tick goes back to its regular count
+  uint8_t phase[] = {13, 20, 47};
+  for (unsigned i = 0; i < sizeof(phase); i++) {
+    set_wpm(phase[i]);
+    hold(1, 1.0);
+    memset(host_ticks_b, 0, sizeof(host_ticks_b));
+    host_run(1000 * MS);
+    printf("%2d WPM: OCR0B %d after keying, %ld of 1000 idle ticks moved\n",
+      phase[i], OCR0B, moved());
+    expect("OCR0B after keying", OCR0B, T0KEYOCR, T0KEYOCR);
+    expect("idle ticks moved", moved(), 0, 1);
+    memset(host_ticks_b, 0, sizeof(host_ticks_b));
+    hold(1, 1.0);
+    long n = 0;
+    for (int c = 0; c < 250; c++) n += host_ticks_b[c];
+    printf("        keying dits: %ld of %ld ticks moved\n", moved(), n);
+    expect("ticks moved while keying (%)", 100.0 * moved() / n, 0, 5);
+  }
+
+  // a bouncy dah press, released with bounce 40 ms in, and a
+  // bouncy dit tap 80 ms in give one dah and the dit after it
+  init_encoder();
+  set_wpm(20);
+  srand(1);
+  int wrong = 0;
+  for (int trial = 0; trial < 200; trial++) {
+    double len[8];
+    host_edges_clear();
+    uint64_t t0 = host_cyc;
+    for (int b = 0; b < 6; b++) {
+      host_pads(0, 1);
+      host_run(bounce(100, 300));
+      host_pads(0, 0);
+      host_run(bounce(50, 150));
+    }
+    host_pads(0, 1);
+    host_run(t0 + 40 * MS - host_cyc);
+    host_pads(0, 0);
+    for (int b = 0; b < 5; b++) {
+      host_run(bounce(100, 400));
+      host_pads(0, 1);
+      host_run(bounce(50, 150));
+      host_pads(0, 0);
+    }
+    host_run(t0 + 80 * MS - host_cyc);
+    for (int b = 0; b < 4; b++) {
+      host_pads(1, 0);
+      host_run(bounce(1000, 2000));
+      host_pads(0, 0);
+      host_run(bounce(80, 160));
+    }
+    host_run(t0 + 1000 * MS - host_cyc);
+    int n = elements(len, 8);
+    if ((n != 2) || (fabs(len[0] - 180) > 0.1) || (fabs(len[1] - 60) > 0.1)) {
+      if (wrong++ < 3) {
+        printf("bounce trial %d: %d elements", trial, n);
+        for (int i = 0; i < n; i++) printf(" %.2f", len[i]);
+        printf("\n");
+      }
+    }
+  }
+  printf("bouncy presses: %d of 200 trials wrong\n", wrong);
+  expect("bouncy press trials wrong", wrong, 0, 0);
+
+  // a single glitch between two ms samples is one contact
+  // sample and keys nothing
+  wrong = 0;
+  for (int trial = 0; trial < 200; trial++) {
+    int len = 4 + rand() % 200;
+    host_edges_clear();
+    host_run(next_ms(100 + rand() % (800 - len)));
+    host_pads(trial & 1, !(trial & 1));
+    host_run(len * 16);
+    host_pads(0, 0);
+    host_run(300 * MS);
+    if (host_nedges) wrong++;
+  }
+  printf("single glitches: %d of 200 keyed an element\n", wrong);
+  expect("glitches keyed", wrong, 0, 0);
+
+  // KY text, the first element of each PARIS to the first
+  // element of the next is 50 dits, a run of spaces is one
+  // word space
+  uint8_t modes[] = {ULTIMATIC, STRAIGHT};
+  uint8_t kywpm[] = {20, 47, 60, 80};
+  for (unsigned m = 0; m < sizeof(modes); m++) {
+    for (unsigned i = 0; i < sizeof(kywpm); i++) {
+      uint64_t up[64];
+      keyermode = modes[m];
+      set_wpm(kywpm[i]);
+      host_edges_clear();
+      for (const char *p = "paris  paris paris "; *p; p++) ky_put(*p);
+      double u = 1200.0 / kywpm[i];
+      host_run(180 * u * MS);
+      int n = downs(up, 64);
+      expect("KY elements", n, 42, 42);
+      if (n != 42) continue;
+      double p1 = (up[14] - up[0]) / MS;
+      double p2 = (up[28] - up[14]) / MS;
+      printf("KY mode %d %2d WPM: PARIS %.3f / %.3f ms, ideal %.3f\n",
+        modes[m], kywpm[i], p1, p2, 50 * u);
+      expect("KY PARIS error (%)", 100 * (p1 - 50 * u) / (50 * u), -0.01, 0.01);
+      expect("KY PARIS error (%)", 100 * (p2 - 50 * u) / (50 * u), -0.01, 0.01);
+      expect("keyer idle after KY", keyerstate, KEY_IDLE, KEY_IDLE);
+    }
+  }
+
+  // characters with no Morse code are dropped, '?' is kept
+  kyhead = kytail = 0;
+  for (const char *p = "a#b?<%z"; *p; p++) ky_put(*p);
+  expect("KY characters queued", kyhead, 4, 4);
+  expect("KY queue is AB?Z", memcmp(kybuf, "AB?Z", 4), 0, 0);
+  kyhead = kytail = 0;
+
+  // straight_key() leaves the key to the tick while it sends
+  keyermode = STRAIGHT;
+  set_wpm(20);
+  ky_put('T');
+  host_run(20 * MS);
+  keyerinfo = 0x55;
+  straight_key();
+  expect("keyerinfo while sending", keyerinfo, 0x55, 0x55);
+  expect("key while sending", host_keyout(), 1, 1);
+  host_run(2000 * MS);
+  host_pads(1, 0);
+  host_run(10 * MS);
+  straight_key();
+  expect("straight key down", host_keyout(), 1, 1);
+  host_pads(0, 0);
+  host_run(10 * MS);
+  straight_key();
+  expect("straight key up", host_keyout(), 0, 0);
+
+  // a dit press flushes the buffer and ends the element on the
+  // next ms, then the dit follows a dit of space
+  keyermode = ULTIMATIC;
+  set_wpm(20);
+  for (int i = 0; i < 3; i++) {
+    for (const char *p = "CQ TEST "; *p; p++) ky_put(*p);
+  }
+  host_run(500 * MS);
+  int keyed = host_keyout();
+  host_edges_clear();
+  uint64_t tp = host_cyc;
+  host_pads(1, 0);
+  host_run(5 * MS);
+  host_pads(0, 0);
+  host_run(3000 * MS);
+  double len[8];
+  int n = elements(len, 8);
+  double off = (host_edges[0].cyc - tp) / MS;
+  double on = (host_edges[keyed ? 1 : 0].cyc - tp) / MS;
+  printf("dit press during KY: key %s %.3f ms later, dit %.3f ms after the press\n",
+    keyed ? "up" : "still up", keyed ? off : 0.0, on);
+  if (keyed) {
+    expect("key up after a dit press (ms)", off, 0, 1.5);
+    expect("dit start after a dit press (ms)", on, 60, 61.5);
+  }
+  expect("elements after a dit press", n, 1, 1);
+  expect("dit after a dit press (ms)", len[0], 59.9, 60.1);
+  expect("KY buffer flushed", kytail == kyhead, 1, 1);
+  expect("keyer idle after a dit press", keyerstate, KEY_IDLE, KEY_IDLE);
+
+  printf("keyer_test: %d failures\n", fails);
+  return fails != 0;
+}
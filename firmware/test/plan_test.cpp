@@ -0,0 +1,123 @@
+// ============================================================================
+//
+// plan_test.cpp - Si5351 PLL allocation and integer multisynths
+//
+// Prints the PA report for both tuning modes, then checks that retunes
+// of the Rx clock never touch PLLB or the calibration clock, and that
+// set_freq() sets the integer bit exactly when the PLL is an even
+// integer multiple of the output.
+//
+// ============================================================================
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <Arduino.h>
+#include "host.h"
+#include "si5351.h"
+
+// from the sketch
+void init_pins();
+void init_timer0();
+void init_uart();
+void init_i2c();
+void init_VFO();
+void init_check();
+void init_oled();
+void init_wpm();
+void init_freq();
+void update_display();
+void check_CAT();
+extern uint32_t vfofreq;
+extern Si5351 si5351;
+
+#define PLLB_REGS   34         // PLLB parameters, 8 bytes
+#define CLK2_CTRL   18
+#define MS_FIXED    80000000000ULL
+
+static int fails = 0;
+
+static void cat(const char *host) {
+  host_serout_clear();
+  host_serin(host);
+  while (host_serin_left()) check_CAT();
+}
+
+static void expect(const char *what, long got, long want) {
+  if (got != want) {
+    printf("%s: %ld, expected %ld\n", what, got, want);
+    fails++;
+  }
+}
+
+// PLLB, the CLK2 control and the CLK2 multisynth
+static void cal_regs(uint8_t *r) {
+  memcpy(r, &si_reg[PLLB_REGS], 8);
+  r[8] = si_reg[CLK2_CTRL];
+  memcpy(&r[9], &si_reg[SI5351_CLK2_PARAMETERS], 8);
+}
+
+// random retunes of the Rx clock across the HF bands
+static void retunes(int n) {
+  uint8_t before[17], after[17];
+  cal_regs(before);
+  for (int i = 0; i < n; i++) {
+    vfofreq = 1800000 + rand() % 28000000;
+    update_display();
+  }
+  cal_regs(after);
+  expect("PLLB and CLK2 registers changed", memcmp(before, after, sizeof(before)) != 0, 0);
+}
+
+int main() {
+  init();
+  init_pins();
+  init_timer0();
+  init_uart();
+  init_i2c();
+  init_VFO();
+  init_check();
+  init_oled();
+  init_wpm();
+  init_freq();
+  update_display();
+  srand(1);
+
+  // the allocation report, MS-tuned and PLL-tuned
+  cat("PA;");
+  printf("MS-tuned%s", host_serout());
+  expect("CAL on PLLB at MS 800 int",
+    strstr(host_serout(), "CAL  1000000  PLLB 800000000  MS 800 int") != NULL, 1);
+  retunes(350);
+  cat("PT;PA;");
+  printf("PLL-tuned%s", strchr(host_serout(), '\n'));
+  retunes(300);
+  cat("PT;");
+
+  // the integer bit over 1-100 MHz, at every frequency that is
+  // 800 MHz over an even integer and at random ones in between
+  long n = 0, nint = 0;
+  for (int i = 0; i < 30000; i++) {
+    uint64_t freq;
+    if (i < 400) {
+      uint32_t div = 8 + 2 * i;
+      if ((div > 800) || (MS_FIXED % div)) continue;
+      freq = MS_FIXED / div;
+    } else {
+      freq = (1000000ULL + rand() % 99000001) * 100;
+    }
+    si5351.set_freq(freq, SI5351_CLK1);
+    int want = !(MS_FIXED % freq) && !((MS_FIXED / freq) & 1);
+    int got = (si_reg[SI5351_CLK0_CTRL + 1] & SI5351_CLK_INTEGER_MODE) != 0;
+    n++;
+    nint += got;
+    if (got != want) {
+      printf("%llu Hz: integer bit %d\n", (unsigned long long)freq / 100, got);
+      fails++;
+    }
+  }
+  printf("integer bit checked on %ld frequencies, %ld integer\n", n, nint);
+
+  printf("plan_test: %d failures\n", fails);
+  return fails != 0;
+}
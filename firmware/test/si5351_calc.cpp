@@ -0,0 +1,105 @@
+// ============================================================================
+//
+// si5351_calc.cpp - compare the 32-bit and 64-bit Si5351 calcs
+//
+// multisynth_calc() and pll_calc() with SI5351_FASTCALC must give the
+// same register values and frequencies as the 64-bit divisions they
+// replace, over the HF range the radio tunes, random targets and PLLs
+// across the whole chip range, and every correction a calibration can
+// store plus the int32_t extremes.
+//
+// ============================================================================
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <Arduino.h>
+#include "i2c.h"
+
+I2C i2c;
+
+uint64_t ms_ref(uint64_t, uint64_t, uint32_t *);
+uint64_t ms_fast(uint64_t, uint64_t, uint32_t *);
+uint64_t pll_ref(uint64_t, int32_t, uint32_t, uint8_t, uint32_t *);
+uint64_t pll_fast(uint64_t, int32_t, uint32_t, uint8_t, uint32_t *);
+
+#define PLL_FIXED  80000000000ULL      // 800 MHz in 0.01 Hz
+
+static unsigned long cases = 0;
+static unsigned long bad = 0;
+
+static uint64_t rand64(uint64_t n) {
+  return (((uint64_t)rand() << 31) | rand()) % n;
+}
+
+static void ms_check(uint64_t freq, uint64_t pll) {
+  uint32_t a[3], b[3];
+  uint64_t x = ms_ref(freq, pll, a);
+  uint64_t y = ms_fast(freq, pll, b);
+  cases++;
+  if ((x != y) || memcmp(a, b, sizeof(a))) {
+    if (bad++ < 10) printf("multisynth_calc %llu off %llu differs\n",
+      (unsigned long long)freq, (unsigned long long)pll);
+  }
+}
+
+static void pll_check(uint64_t freq, int32_t corr, uint32_t xtal, uint8_t vcxo) {
+  uint32_t a[3], b[3];
+  uint64_t x = pll_ref(freq, corr, xtal, vcxo, a);
+  uint64_t y = pll_fast(freq, corr, xtal, vcxo, b);
+  cases++;
+  if ((x != y) || memcmp(a, b, sizeof(a))) {
+    if (bad++ < 10) printf("pll_calc %llu corr %ld xtal %lu vcxo %d differs\n",
+      (unsigned long long)freq, (long)corr, (unsigned long)xtal, vcxo);
+  }
+}
+
+int main(int argc, char **argv) {
+  // the full sweep takes a while, "quick" runs a tenth of it
+  long n = ((argc > 1) && !strcmp(argv[1], "quick")) ? 10 : 1;
+  srand(1);
+
+  // every 1 Hz from 500 kHz to 30 MHz off the fixed PLL
+  for (uint64_t hz = 500000; hz <= 30000000; hz += n) {
+    ms_check(hz * 100, PLL_FIXED);
+  }
+
+  // random 0.01 Hz targets over the whole range, random PLLs
+  for (long i = 0; i < 20000000 / n; i++) {
+    uint64_t pll = (i & 1) ? PLL_FIXED : 60000000000ULL + rand64(30000000001ULL);
+    ms_check(rand64(22500000000ULL) + 1, pll);
+  }
+
+  // every correction in +-100 ppm at a few VCOs
+  uint64_t vco[] = {80000000000ULL, 60000000000ULL, 90000000000ULL,
+                    72345678901ULL, 50000000000ULL, 99999999999ULL};
+  for (int32_t c = -100000; c <= 100000; c += n) {
+    for (int v = 0; v < 6; v++) {
+      pll_check(vco[v], c, 25000000, 0);
+      pll_check(vco[v], c, 25000000, 1);
+    }
+  }
+
+  // random VCOs, corrections up to 1000 ppm and crystals
+  for (long i = 0; i < 10000000 / n; i++) {
+    uint64_t f = 60000000000ULL + rand64(30000000001ULL);
+    int32_t c = (rand() % 2000001) - 1000000;
+    uint32_t xtal = 10000000 + rand() % 30000001;
+    pll_check(f, c, xtal, rand() & 1);
+  }
+
+  // corrections at and past SI5351_CORR_MAX, out to the int32_t ends
+  int32_t corr[] = {INT32_MIN, INT32_MIN + 1, -500000000, -1000001,
+                    -1000000, 1000000, 1000001, 500000000, INT32_MAX};
+  for (unsigned i = 0; i < sizeof(corr) / sizeof(corr[0]); i++) {
+    for (int v = 0; v < 6; v++) {
+      for (uint32_t xtal = 10000000; xtal <= 40000000; xtal += 5000000) {
+        pll_check(vco[v], corr[i], xtal, 0);
+        pll_check(vco[v], corr[i], xtal, 1);
+      }
+    }
+  }
+
+  printf("si5351_calc: %lu cases, %lu mismatches\n", cases, bad);
+  return bad != 0;
+}